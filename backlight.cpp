@@ -0,0 +1,165 @@
+#include "backlight.h"
+
+#include "zlog.h"
+
+BacklightStream::BacklightStream(ProtoQMK *qmk_, zu32 fps) :
+    qmk(qmk_), interval(1000000 / (fps ? fps : 1)),
+    rows(0), cols(0), tsize(0),
+    running(false), pending(false),
+    sent(0), dropped(0), errors(0), latency_total(0)
+{
+
+}
+
+BacklightStream::~BacklightStream(){
+    stop();
+}
+
+bool BacklightStream::start(){
+    if(running)
+        return true;
+
+    ZBinary info;
+    if(!qmk->getBacklightInfo(info))
+        return false;
+    rows = info[1];
+    cols = info[2];
+    tsize = info[3];
+    if(!frameSize()){
+        ELOG("no backlight map");
+        return false;
+    }
+
+    // Read current frame from layer 0
+    ZBinary current;
+    for(zu32 off = 0; off < frameSize(); off += 60){
+        if(!qmk->readBacklight(off, current))
+            return false;
+    }
+    current.resize(frameSize());
+
+    front = current;
+    back = current;
+    pending = false;
+    sent = 0;
+    dropped = 0;
+    errors = 0;
+    latency_total = 0;
+    started = clock::now();
+
+    running = true;
+    if(!thread.run(stream_thread, this)){
+        ELOG("failed to start backlight stream");
+        running = false;
+        return false;
+    }
+    return true;
+}
+
+void BacklightStream::stop(){
+    mutex.lock();
+    const bool was = running;
+    running = false;
+    mutex.unlock();
+    if(was)
+        thread.join();
+}
+
+ZBinary BacklightStream::frame() const {
+    mutex.lock();
+    ZBinary current = back;
+    mutex.unlock();
+    return current;
+}
+
+bool BacklightStream::submit(const ZBinary &frame){
+    if(frame.size() != frameSize()){
+        ELOG("bad backlight frame size");
+        return false;
+    }
+    mutex.lock();
+    const bool ok = running;
+    if(ok){
+        // newer frame replaces the one not sent yet
+        if(pending)
+            dropped++;
+        back = frame;
+        pending = true;
+        submitted = clock::now();
+    }
+    mutex.unlock();
+    return ok;
+}
+
+BacklightStream::Stats BacklightStream::stats() const {
+    mutex.lock();
+    Stats st;
+    const double secs = std::chrono::duration<double>(clock::now() - started).count();
+    st.fps = secs > 0 ? sent / secs : 0;
+    st.latency_ms = sent ? latency_total / sent : 0;
+    st.sent = sent;
+    st.dropped = dropped;
+    st.errors = errors;
+    mutex.unlock();
+    return st;
+}
+
+void *BacklightStream::stream_thread(ZThread::ZThreadArg zarg){
+    ((BacklightStream *)zarg.arg)->run();
+    return nullptr;
+}
+
+void BacklightStream::run(){
+    clock::time_point next = clock::now();
+    while(true){
+        // wait for a frame, a pending frame is still sent after stop()
+        mutex.lock();
+        if(!pending){
+            const bool stop = !running;
+            mutex.unlock();
+            if(stop)
+                break;
+            ZThread::msleep(BACKLIGHT_POLL_MS);
+            continue;
+        }
+
+        ZBinary frame = back;
+        const clock::time_point stamp = submitted;
+        pending = false;
+        mutex.unlock();
+
+        // only write entries changed since the last frame
+        auto regions = ProtoQMK::diffRegions(front, frame, QMK_DIFF_GAP, tsize);
+        const bool ok = qmk->writeBacklightRegions(frame, regions);
+        const clock::time_point done = clock::now();
+
+        if(ok){
+            front = frame;
+        } else {
+            // device state unknown, rewrite the whole next frame
+            front.clear();
+        }
+
+        mutex.lock();
+        if(ok){
+            sent++;
+            latency_total += std::chrono::duration<double, std::milli>(done - stamp).count();
+        } else {
+            errors++;
+        }
+        mutex.unlock();
+
+        // hold the frame rate, frames submitted meanwhile replace each other
+        next += interval;
+        if(next < done)
+            next = done;
+        while(clock::now() < next){
+            mutex.lock();
+            const bool stop = !running;
+            mutex.unlock();
+            if(stop)
+                break;
+            ZThread::msleep(BACKLIGHT_POLL_MS);
+        }
+    }
+}
@@ -0,0 +1,86 @@
+#ifndef BACKLIGHT_H
+#define BACKLIGHT_H
+
+#include "proto_qmk.h"
+
+#include <chrono>
+
+#include "zbinary.h"
+#include "zthread.h"
+#include "zmutex.h"
+using namespace LibChaos;
+
+//! Milliseconds the stream thread sleeps while waiting for a frame.
+#define BACKLIGHT_POLL_MS   1
+
+/*! Streams backlight frames to a QMK keyboard from a background thread.
+ *  A frame is one backlight map layer (rows * cols entries of the type size
+ *  reported by SUB_BL_INFO). Only entries changed since the last frame sent
+ *  are written. If a new frame is submitted before the previous one was sent,
+ *  the previous frame is dropped.
+ *  The ProtoQMK device must not be used by anything else while streaming.
+ */
+class BacklightStream {
+public:
+    struct Stats {
+        double fps;         //!< Achieved frames sent per second.
+        double latency_ms;  //!< Average time from submit to frame written.
+        zu64 sent;          //!< Frames sent.
+        zu64 dropped;       //!< Frames replaced before they were sent.
+        zu64 errors;        //!< Frames that failed to write.
+    };
+
+public:
+    BacklightStream(ProtoQMK *qmk, zu32 fps);
+    BacklightStream(const BacklightStream &) = delete;
+    ~BacklightStream();
+
+    //! Read the backlight map info and current frame, and start the stream thread.
+    bool start();
+    //! Stop the stream thread, after sending any pending frame.
+    void stop();
+
+    //! Size of a frame in bytes.
+    zu32 frameSize() const { return rows * cols * tsize; }
+    zu8 numRows() const { return rows; }
+    zu8 numCols() const { return cols; }
+    //! Size of one key entry in bytes.
+    zu8 entrySize() const { return tsize; }
+
+    //! Get the current frame (last submitted, or read from the keyboard).
+    ZBinary frame() const;
+    //! Queue \a frame to be sent, replacing any frame not sent yet. Does not block on the device.
+    bool submit(const ZBinary &frame);
+
+    Stats stats() const;
+
+private:
+    static void *stream_thread(ZThread::ZThreadArg zarg);
+    void run();
+
+private:
+    typedef std::chrono::steady_clock clock;
+
+    ProtoQMK *qmk;
+    const std::chrono::microseconds interval;
+    zu8 rows, cols, tsize;
+
+    ZThread thread;
+    mutable ZMutex mutex;
+    bool running;
+
+    //! Frame last written to the keyboard, only used by the stream thread.
+    ZBinary front;
+    //! Newest submitted frame.
+    ZBinary back;
+    bool pending;
+    clock::time_point submitted;
+
+    clock::time_point started;
+    zu64 sent;
+    zu64 dropped;
+    zu64 errors;
+    double latency_total;
+};
+
+#endif // BACKLIGHT_H
@@ -0,0 +1,367 @@
+#include "decodecache.h"
+#include "fileutil.h"
+
+#include "zfile.h"
+#include "zlog.h"
+
+#include <vector>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/stat.h>
+
+#if LIBCHAOS_PLATFORM == LIBCHAOS_PLATFORM_WINDOWS
+    #include <sys/utime.h>
+#else
+    #include <utime.h>
+#endif
+
+#define ENTRY_MAGIC     "PKGC"
+#define ENTRY_EXT       ".pkgc"
+// Bump when decoder output changes, to ignore old entries
+#define CACHE_VERSION   2
+#define FINGERPRINT_FILE    "fingerprints"
+#define FINGERPRINT_HEADER  "pok3rtool-fingerprints 2"
+
+// Bounds checked reader over a cache entry
+struct EntryReader {
+    const zbyte *data;
+    zu64 size;
+    zu64 pos;
+    bool ok;
+
+    EntryReader(const ZBinary &bin) : data(bin.raw()), size(bin.size()), pos(0), ok(true){}
+
+    const zbyte *take(zu64 len){
+        if(!ok || len > size - pos){
+            ok = false;
+            return nullptr;
+        }
+        const zbyte *ptr = data + pos;
+        pos += len;
+        return ptr;
+    }
+    zu16 u16(){
+        const zbyte *ptr = take(2);
+        return ptr ? ZBinary::decleu16(ptr) : 0;
+    }
+    zu32 u32(){
+        const zbyte *ptr = take(4);
+        return ptr ? ZBinary::decleu32(ptr) : 0;
+    }
+    zu64 u64(){
+        const zbyte *ptr = take(8);
+        return ptr ? ZBinary::decleu64(ptr) : 0;
+    }
+    ZString str(){
+        const zu16 len = u16();
+        const zbyte *ptr = take(len);
+        return ptr ? ZString(ptr, len) : ZString();
+    }
+    void bin(ZBinary &out){
+        const zu32 len = u32();
+        const zbyte *ptr = take(len);
+        out.resize(ptr ? len : 0);
+        if(ptr && len)
+            memcpy(out.raw(), ptr, len);
+    }
+};
+
+static void write_str(ZBinary &bin, const ZString &str){
+    const std::string s = str.str();
+    const zu16 len = s.size() > 0xFFFF ? 0xFFFF : s.size();
+    bin.writeleu16(len);
+    bin.write((const zbyte *)s.data(), len);
+}
+
+static void write_bin(ZBinary &bin, const ZBinary &data){
+    bin.writeleu32(data.size());
+    bin.write(data);
+}
+
+DecodeCache &DecodeCache::global(){
+    static DecodeCache cache;
+    return cache;
+}
+
+DecodeCache::DecodeCache() : max_size(DECODE_CACHE_MAX_SIZE), fingerprints_loaded(false), fingerprint_lines(0){
+    const char *env = getenv(DECODE_CACHE_ENV);
+    if(env){
+        path = env;
+        return;
+    }
+#if LIBCHAOS_PLATFORM == LIBCHAOS_PLATFORM_WINDOWS
+    const char *base = getenv("LOCALAPPDATA");
+    if(base)
+        path = std::string(base) + "/pok3rtool";
+#else
+    const char *base = getenv("XDG_CACHE_HOME");
+    if(base && *base){
+        path = std::string(base) + "/pok3rtool";
+    } else {
+        base = getenv("HOME");
+        if(base)
+            path = std::string(base) + "/.cache/pok3rtool";
+    }
+#endif
+}
+
+void DecodeCache::setPath(ZPath dir){
+    std::lock_guard<std::mutex> lock(mutex);
+    path = dir.str().str();
+    fingerprints_loaded = false;
+    fingerprint_lines = 0;
+    fingerprints.clear();
+}
+
+void DecodeCache::setMaxSize(zu64 size){
+    std::lock_guard<std::mutex> lock(mutex);
+    max_size = size;
+}
+
+std::string DecodeCache::entryPath(zu64 hash) const {
+    return path + "/" + ZString::ItoS(hash, 16, 16).str() + ENTRY_EXT;
+}
+
+bool DecodeCache::load(zu64 hash, PackageInfo &info){
+    std::lock_guard<std::mutex> lock(mutex);
+    if(path.empty())
+        return false;
+    const std::string file = entryPath(hash);
+    struct stat st;
+    if(stat(file.c_str(), &st) != 0)
+        return false;
+
+    ZBinary bin;
+    if(!ZFile::readBinary(ZString(file), bin))
+        return false;
+
+    EntryReader in(bin);
+    const zbyte *magic = in.take(4);
+    if(!magic || memcmp(magic, ENTRY_MAGIC, 4) != 0 || in.u16() != CACHE_VERSION || in.u64() != hash){
+        DLOG("Ignoring cache entry " << ZString(file));
+        return false;
+    }
+
+    PackageInfo entry;
+    entry.hash = hash;
+    entry.type = (PackType)in.u16();
+    entry.description = in.str();
+    entry.company = in.str();
+    entry.product = in.str();
+    entry.version = in.str();
+    entry.signature = in.str();
+    entry.output = in.u64();
+    const zu16 count = in.u16();
+    entry.firmwares.resize(in.ok ? count : 0);
+    for(zu16 i = 0; in.ok && i < count; ++i){
+        PackageFirmware &fw = entry.firmwares[i];
+        fw.description = in.str();
+        fw.version = in.str();
+        for(zu16 j = 0, n = in.u16(); in.ok && j < n; ++j)
+            fw.layouts.push(in.str());
+        in.bin(fw.firmware);
+        in.bin(fw.info);
+    }
+    if(!in.ok || in.pos != in.size){
+        DLOG("Corrupt cache entry " << ZString(file));
+        return false;
+    }
+
+    // mark as recently used
+    utime(file.c_str(), NULL);
+
+    info = entry;
+    DLOG("Cache hit " << ZString(file));
+    return true;
+}
+
+bool DecodeCache::store(const PackageInfo &info){
+    std::lock_guard<std::mutex> lock(mutex);
+    if(path.empty())
+        return false;
+    if(!makeDirs(ZString(path)))
+        return false;
+
+    ZBinary bin;
+    bin.write((const zbyte *)ENTRY_MAGIC, 4);
+    bin.writeleu16(CACHE_VERSION);
+    bin.writeleu64(info.hash);
+    bin.writeleu16(info.type);
+    write_str(bin, info.description);
+    write_str(bin, info.company);
+    write_str(bin, info.product);
+    write_str(bin, info.version);
+    write_str(bin, info.signature);
+    bin.writeleu64(info.output);
+    bin.writeleu16(info.firmwares.size());
+    for(zu64 i = 0; i < info.firmwares.size(); ++i){
+        const PackageFirmware &fw = info.firmwares[i];
+        write_str(bin, fw.description);
+        write_str(bin, fw.version);
+        bin.writeleu16(fw.layouts.size());
+        for(zu64 j = 0; j < fw.layouts.size(); ++j)
+            write_str(bin, fw.layouts[j]);
+        write_bin(bin, fw.firmware);
+        write_bin(bin, fw.info);
+    }
+
+    // write to a temporary file and rename, so readers never see a partial entry
+    const std::string file = entryPath(info.hash);
+    const std::string tmp = file + ".tmp";
+    if(!ZFile::writeBinary(ZString(tmp), bin)){
+        ELOG("Failed to write cache entry " << ZString(tmp));
+        return false;
+    }
+    std::remove(file.c_str());
+    if(std::rename(tmp.c_str(), file.c_str()) != 0){
+        ELOG("Failed to write cache entry " << ZString(file));
+        std::remove(tmp.c_str());
+        return false;
+    }
+
+    evict();
+    return true;
+}
+
+void DecodeCache::evict(){
+    ZArray<ZPath> files;
+    if(!listFiles(ZString(path), files, ENTRY_EXT))
+        return;
+
+    struct Entry {
+        std::string file;
+        zs64 mtime;
+        zu64 size;
+    };
+    std::vector<Entry> entries;
+    zu64 total = 0;
+    for(zu64 i = 0; i < files.size(); ++i){
+        Entry entry;
+        entry.file = files[i].str().str();
+        struct stat st;
+        if(stat(entry.file.c_str(), &st) != 0)
+            continue;
+        entry.mtime = st.st_mtime;
+        entry.size = st.st_size;
+        total += entry.size;
+        entries.push_back(entry);
+    }
+    if(total <= max_size)
+        return;
+
+    // oldest first, always keeping the newest entry
+    std::sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b){
+        return a.mtime < b.mtime;
+    });
+    for(size_t i = 0; i + 1 < entries.size() && total > max_size; ++i){
+        DLOG("Evict " << ZString(entries[i].file));
+        if(std::remove(entries[i].file.c_str()) == 0)
+            total -= entries[i].size;
+    }
+}
+
+bool DecodeCache::findFingerprint(zu64 size, zu64 trailer, zu64 &hash, zu64 &sample){
+    std::lock_guard<std::mutex> lock(mutex);
+    loadFingerprints();
+    auto it = fingerprints.find(std::make_pair(size, trailer));
+    if(it == fingerprints.end())
+        return false;
+    hash = it->second.hash;
+    sample = it->second.sample;
+    return true;
+}
+
+void DecodeCache::addFingerprint(zu64 size, zu64 trailer, zu64 hash, zu64 sample){
+    std::lock_guard<std::mutex> lock(mutex);
+    if(path.empty())
+        return;
+    loadFingerprints();
+    auto key = std::make_pair(size, trailer);
+    auto it = fingerprints.find(key);
+    if(it != fingerprints.end() && it->second.hash == hash && it->second.sample == sample)
+        return;
+    Fingerprint &fp = fingerprints[key];
+    fp.hash = hash;
+    fp.sample = sample;
+    fp.seq = fingerprint_lines++;
+
+    if(!makeDirs(ZString(path)))
+        return;
+    // rewrite a new or outdated index with its header
+    if(fingerprint_lines == 1 || fingerprint_lines > FINGERPRINT_MAX){
+        compactFingerprints();
+        return;
+    }
+    // append, later lines replace earlier ones when loaded
+    std::ofstream out(path + "/" FINGERPRINT_FILE, std::ios::app);
+    out << std::hex << size << " " << trailer << " " << hash << " " << sample << "\n";
+    if(!out)
+        DLOG("Unable to write fingerprint index");
+}
+
+void DecodeCache::loadFingerprints(){
+    if(fingerprints_loaded || path.empty())
+        return;
+    fingerprints_loaded = true;
+
+    // header, then size, trailer hash, full hash, sample hash, in hex
+    std::ifstream in(path + "/" FINGERPRINT_FILE);
+    std::string line;
+    if(!std::getline(in, line) || line != FINGERPRINT_HEADER)
+        return;
+    while(std::getline(in, line)){
+        std::istringstream fields(line);
+        zu64 size, trailer;
+        Fingerprint fp;
+        if(fields >> std::hex >> size >> trailer >> fp.hash >> fp.sample){
+            fp.seq = fingerprint_lines++;
+            fingerprints[std::make_pair(size, trailer)] = fp;
+        }
+    }
+}
+
+void DecodeCache::compactFingerprints(){
+    typedef std::map<std::pair<zu64, zu64>, Fingerprint>::const_iterator Iter;
+    std::vector<Iter> order;
+    for(Iter it = fingerprints.begin(); it != fingerprints.end(); ++it)
+        order.push_back(it);
+    std::sort(order.begin(), order.end(), [](const Iter &a, const Iter &b){
+        return a->second.seq < b->second.seq;
+    });
+
+    // keep the newest half, so the index is not rewritten on every add
+    const size_t drop = order.size() > FINGERPRINT_MAX / 2 ? order.size() - FINGERPRINT_MAX / 2 : 0;
+    std::map<std::pair<zu64, zu64>, Fingerprint> keep;
+    std::ostringstream out;
+    out << FINGERPRINT_HEADER "\n" << std::hex;
+    for(size_t i = drop; i < order.size(); ++i){
+        Fingerprint fp = order[i]->second;
+        fp.seq = i - drop;
+        keep[order[i]->first] = fp;
+        out << order[i]->first.first << " " << order[i]->first.second << " " << fp.hash << " " << fp.sample << "\n";
+    }
+    DLOG("Compact fingerprint index: " << order.size() << " -> " << keep.size());
+    fingerprints.swap(keep);
+    fingerprint_lines = fingerprints.size();
+
+    // write to a temporary file and rename, like cache entries
+    const std::string file = path + "/" FINGERPRINT_FILE;
+    const std::string tmp = file + ".tmp";
+    {
+        std::ofstream tmpout(tmp.c_str(), std::ios::trunc);
+        tmpout << out.str();
+        if(!tmpout){
+            DLOG("Unable to write fingerprint index");
+            return;
+        }
+    }
+    std::remove(file.c_str());
+    if(std::rename(tmp.c_str(), file.c_str()) != 0){
+        DLOG("Unable to write fingerprint index");
+        std::remove(tmp.c_str());
+    }
+}
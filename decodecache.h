@@ -0,0 +1,78 @@
+#ifndef DECODECACHE_H
+#define DECODECACHE_H
+
+#include "updatepackage.h"
+
+#include "zstring.h"
+#include "zpath.h"
+#include "zbinary.h"
+using namespace LibChaos;
+
+#include <string>
+#include <mutex>
+#include <map>
+#include <utility>
+
+#define DECODE_CACHE_ENV        "POK3RTOOL_CACHE_DIR"
+#define DECODE_CACHE_MAX_SIZE   (256 * 1024 * 1024)
+#define FINGERPRINT_MAX         4096
+
+/*! Decoded updater packages, stored on disk by updater hash.
+ *  Each entry holds the PackageInfo of one updater, with all of its firmware. Entries
+ *  are stamped with the decoder version, so a change to the decoders ignores old entries.
+ *  When the cache grows past its size limit, the least recently used entries
+ *  (by file modification time, refreshed on each hit) are removed.
+ *  The cache also keeps a fingerprint index of updaters hashed in full: the full hash
+ *  and a hash of sampled blocks of each, keyed by file size and a hash of the last
+ *  few KB of the file. A fingerprint is only a candidate until the sample is checked.
+ *  The index keeps the newest FINGERPRINT_MAX fingerprints.
+ *  The directory is taken from POK3RTOOL_CACHE_DIR, or a pok3rtool directory
+ *  in the user cache directory.
+ */
+class DecodeCache {
+public:
+    //! Get the process-wide decode cache.
+    static DecodeCache &global();
+
+    //! Use \a dir for cache entries. An empty path disables the cache.
+    void setPath(ZPath dir);
+    void setMaxSize(zu64 size);
+    bool enabled() const { return !path.empty(); }
+
+    //! Load the entry for \a hash, false on a miss.
+    bool load(zu64 hash, PackageInfo &info);
+    //! Store an entry for \a info.hash, then evict old entries if over the size limit.
+    bool store(const PackageInfo &info);
+
+    //! Find the candidate full hash and \a sample hash of a file with \a size and \a trailer hash,
+    //! false if not seen before.
+    bool findFingerprint(zu64 size, zu64 trailer, zu64 &hash, zu64 &sample);
+    //! Remember the full hash and \a sample hash of a file with \a size and \a trailer hash.
+    void addFingerprint(zu64 size, zu64 trailer, zu64 hash, zu64 sample);
+
+private:
+    DecodeCache();
+
+    std::string entryPath(zu64 hash) const;
+    void evict();
+    void loadFingerprints();
+    void compactFingerprints();
+
+private:
+    struct Fingerprint {
+        zu64 hash;
+        zu64 sample;
+        //! Line order in the index, to keep the newest when compacting.
+        zu64 seq;
+    };
+
+    std::mutex mutex;
+    std::string path;
+    zu64 max_size;
+    bool fingerprints_loaded;
+    //! Lines in the index file, including replaced fingerprints.
+    zu64 fingerprint_lines;
+    std::map<std::pair<zu64, zu64>, Fingerprint> fingerprints;
+};
+
+#endif // DECODECACHE_H
@@ -0,0 +1,96 @@
+#include "fileutil.h"
+#include "zlog.h"
+
+#include <sys/stat.h>
+#include <errno.h>
+
+#if LIBCHAOS_PLATFORM == LIBCHAOS_PLATFORM_WINDOWS
+    #include <windows.h>
+    #include <direct.h>
+    #define MKDIR(P) _mkdir(P)
+#else
+    #include <dirent.h>
+    #define MKDIR(P) mkdir(P, 0755)
+#endif
+
+#include <string>
+#include <cstdio>
+#include <vector>
+#include <algorithm>
+
+bool listFiles(ZPath dir, ZArray<ZPath> &files, ZString ext){
+    const std::string dname = dir.str().str();
+    const std::string suffix = ext.str();
+
+    std::vector<std::string> names;
+#if LIBCHAOS_PLATFORM == LIBCHAOS_PLATFORM_WINDOWS
+    WIN32_FIND_DATAA fd;
+    HANDLE find = FindFirstFileA((dname + "\\*").c_str(), &fd);
+    if(find == INVALID_HANDLE_VALUE){
+        ELOG("failed to open directory " << dir);
+        return false;
+    }
+    do {
+        const std::string name = fd.cFileName;
+        if(fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+            continue;
+        if(name.size() < suffix.size() || name.compare(name.size() - suffix.size(), suffix.size(), suffix) != 0)
+            continue;
+        names.push_back(name);
+    } while(FindNextFileA(find, &fd));
+    FindClose(find);
+#else
+    DIR *dp = opendir(dname.c_str());
+    if(!dp){
+        ELOG("failed to open directory " << dir);
+        return false;
+    }
+
+    struct dirent *ent;
+    while((ent = readdir(dp)) != NULL){
+        const std::string name = ent->d_name;
+        if(name.size() < suffix.size() || name.compare(name.size() - suffix.size(), suffix.size(), suffix) != 0)
+            continue;
+        struct stat st;
+        if(stat((dname + "/" + name).c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+            continue;
+        names.push_back(name);
+    }
+    closedir(dp);
+#endif
+
+    std::sort(names.begin(), names.end());
+    for(size_t i = 0; i < names.size(); ++i)
+        files.push(dir + ZPath(ZString(names[i])));
+    return true;
+}
+
+bool makeDirs(ZPath dir){
+    const std::string path = dir.str().str();
+    // create each prefix ending before a separator, then the whole path
+    for(size_t i = 1; i <= path.size(); ++i){
+        if(i < path.size() && path[i] != '/' && path[i] != '\\')
+            continue;
+        const std::string part = path.substr(0, i);
+        if(MKDIR(part.c_str()) != 0 && errno != EEXIST){
+            ELOG("failed to create directory " << ZString(part));
+            return false;
+        }
+    }
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 && (st.st_mode & S_IFMT) == S_IFDIR;
+}
+
+bool replaceFile(ZPath from, ZPath to){
+    const std::string src = from.str().str();
+    const std::string dst = to.str().str();
+#if LIBCHAOS_PLATFORM == LIBCHAOS_PLATFORM_WINDOWS
+    if(!MoveFileExA(src.c_str(), dst.c_str(), MOVEFILE_REPLACE_EXISTING)){
+#else
+    if(rename(src.c_str(), dst.c_str()) != 0){
+#endif
+        ELOG("failed to replace " << to);
+        return false;
+    }
+    return true;
+}
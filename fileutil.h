@@ -0,0 +1,17 @@
+#ifndef FILEUTIL_H
+#define FILEUTIL_H
+
+#include "zpath.h"
+#include "zarray.h"
+using namespace LibChaos;
+
+//! List the regular files in \a dir ending with \a ext, sorted by name.
+bool listFiles(ZPath dir, ZArray<ZPath> &files, ZString ext = ZString());
+
+//! Create \a dir and any missing parent directories.
+bool makeDirs(ZPath dir);
+
+//! Rename \a from over \a to, replacing any existing file in one step.
+bool replaceFile(ZPath from, ZPath to);
+
+#endif // FILEUTIL_H
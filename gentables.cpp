@@ -0,0 +1,294 @@
+/*  Build-time table generator.
+ *  Compiles the layout JSON files in keymaps/ into constant tables,
+ *  so no JSON is parsed at runtime, and generates the lookup tables
+ *  for the keycode table in keycode_table.h.
+ *
+ *  Usage: gentables layouts <output header> <layout json>...
+ *         gentables keycodes <output header>
+ */
+
+#include "keycode_table.h"
+
+#include <nlohmann/json.hpp>
+
+#include <cstdio>
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+// Must match name_hash() in keymap.cpp
+static uint32_t fnv1a(const std::string &str){
+    uint32_t hash = 2166136261u;
+    for(unsigned char c : str){
+        hash ^= c;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static std::string c_ident(const std::string &str){
+    std::string out;
+    for(char c : str)
+        out += (isalnum((unsigned char)c) ? c : '_');
+    return out;
+}
+
+static std::string c_string(const std::string &str){
+    std::string out = "\"";
+    for(unsigned char c : str){
+        if(c == '"' || c == '\\'){
+            out += '\\';
+            out += c;
+        } else if(c < 0x20 || c >= 0x7F){
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\%03o", c);
+            out += buf;
+        } else {
+            out += c;
+        }
+    }
+    return out + "\"";
+}
+
+// Open addressing hash table of (index + 1), 0 is empty
+static std::vector<unsigned> hash_slots(const std::vector<std::string> &names){
+    size_t size = 1;
+    while(size < names.size() * 2)
+        size <<= 1;
+    std::vector<unsigned> slots(size, 0);
+    for(size_t i = 0; i < names.size(); ++i){
+        size_t s = fnv1a(names[i]) & (size - 1);
+        while(slots[s])
+            s = (s + 1) & (size - 1);
+        slots[s] = i + 1;
+    }
+    return slots;
+}
+
+static void write_slots(std::ostream &out, const std::string &name, const std::vector<unsigned> &slots){
+    out << "static constexpr unsigned short " << name << "[] = {";
+    for(size_t i = 0; i < slots.size(); ++i)
+        out << (i % 16 ? " " : "\n    ") << slots[i] << ",";
+    out << "\n};\n";
+    out << "static constexpr unsigned " << name << "_mask = " << (slots.size() - 1) << ";\n\n";
+}
+
+struct Layout {
+    std::string name;
+    std::vector<std::vector<int>> rows;
+    std::vector<std::vector<std::string>> layers;
+};
+
+static int gen_layouts(const std::string &output, const std::vector<std::string> &inputs){
+    std::vector<Layout> layouts;
+    for(const std::string &path : inputs){
+        std::ifstream file(path);
+        if(!file){
+            std::cerr << "gentables: cannot open " << path << std::endl;
+            return 1;
+        }
+        std::stringstream text;
+        text << file.rdbuf();
+
+        Layout layout;
+        try {
+            auto json = nlohmann::json::parse(text.str());
+            layout.name = json["name"].get<std::string>();
+            for(auto &jrow : json["layout"]){
+                std::vector<int> row;
+                for(auto &jkey : jrow)
+                    row.push_back(jkey.get<int>());
+                if(row.empty())
+                    throw std::runtime_error("empty layout row");
+                layout.rows.push_back(row);
+            }
+            if(json.count("layers")){
+                for(auto &jlayer : json["layers"]){
+                    std::vector<std::string> layer;
+                    for(auto &jlabel : jlayer)
+                        layer.push_back(jlabel.get<std::string>());
+                    layout.layers.push_back(layer);
+                }
+            }
+        } catch(const std::exception &e){
+            std::cerr << "gentables: " << path << ": " << e.what() << std::endl;
+            return 1;
+        }
+        if(layout.rows.empty() || layout.rows.size() > 255){
+            std::cerr << "gentables: " << path << ": bad layout" << std::endl;
+            return 1;
+        }
+        layouts.push_back(layout);
+    }
+
+    std::sort(layouts.begin(), layouts.end(), [](const Layout &a, const Layout &b){ return a.name < b.name; });
+    for(size_t i = 1; i < layouts.size(); ++i){
+        if(layouts[i].name == layouts[i-1].name){
+            std::cerr << "gentables: duplicate layout " << layouts[i].name << std::endl;
+            return 1;
+        }
+    }
+    // different names can map to the same identifier
+    std::vector<std::string> ids;
+    for(const Layout &layout : layouts){
+        const std::string id = c_ident(layout.name);
+        auto it = std::find(ids.begin(), ids.end(), id);
+        if(it != ids.end()){
+            std::cerr << "gentables: layout " << layout.name << " and " << layouts[it - ids.begin()].name <<
+                         " have the same identifier " << id << std::endl;
+            return 1;
+        }
+        ids.push_back(id);
+    }
+
+    std::ostringstream out;
+    out << "// Generated by gentables from keymaps/*.json, do not edit.\n\n";
+    out << "struct LayoutTable {\n"
+           "    const char *name;\n"
+           "    //! Layout key widths, including spacers.\n"
+           "    const unsigned char *keys;\n"
+           "    unsigned short nkeys;\n"
+           "    //! Number of keys in each row.\n"
+           "    const unsigned char *rows;\n"
+           "    unsigned char nrows;\n"
+           "    //! Default layer key labels.\n"
+           "    const char *const *const *layers;\n"
+           "    const unsigned short *layer_sizes;\n"
+           "    unsigned char nlayers;\n"
+           "};\n\n";
+
+    std::vector<std::string> names;
+    for(const Layout &layout : layouts){
+        const std::string id = "layout_" + c_ident(layout.name);
+        names.push_back(layout.name);
+
+        out << "static constexpr unsigned char " << id << "_keys[] = {";
+        for(const auto &row : layout.rows){
+            out << "\n   ";
+            for(int w : row)
+                out << " " << w << ",";
+        }
+        out << "\n};\n";
+
+        out << "static constexpr unsigned char " << id << "_rows[] = {";
+        for(const auto &row : layout.rows)
+            out << " " << row.size() << ",";
+        out << " };\n";
+
+        for(size_t l = 0; l < layout.layers.size(); ++l){
+            out << "static constexpr const char *" << id << "_layer" << l << "[] = {";
+            for(size_t k = 0; k < layout.layers[l].size(); ++k)
+                out << (k % 16 ? " " : "\n    ") << c_string(layout.layers[l][k]) << ",";
+            out << " nullptr,\n};\n";
+        }
+        out << "static constexpr const char *const *" << id << "_layers[] = {";
+        for(size_t l = 0; l < layout.layers.size(); ++l)
+            out << " " << id << "_layer" << l << ",";
+        out << " nullptr };\n";
+        out << "static constexpr unsigned short " << id << "_layer_sizes[] = {";
+        for(size_t l = 0; l < layout.layers.size(); ++l)
+            out << " " << layout.layers[l].size() << ",";
+        out << " 0 };\n\n";
+    }
+
+    out << "static constexpr LayoutTable layout_tables[] = {\n";
+    for(const Layout &layout : layouts){
+        const std::string id = "layout_" + c_ident(layout.name);
+        size_t nkeys = 0;
+        for(const auto &row : layout.rows)
+            nkeys += row.size();
+        out << "    { " << c_string(layout.name) << ", "
+            << id << "_keys, " << nkeys << ", "
+            << id << "_rows, " << layout.rows.size() << ", "
+            << id << "_layers, " << id << "_layer_sizes, " << layout.layers.size() << " },\n";
+    }
+    out << "};\n";
+    out << "static constexpr unsigned layout_tables_size = " << layouts.size() << ";\n\n";
+
+    out << "// Layout name lookup, FNV-1a hash of name\n";
+    write_slots(out, "layout_name_slots", hash_slots(names));
+
+    std::ofstream file(output);
+    file << out.str();
+    return file ? 0 : 1;
+}
+
+static int gen_keycodes(const std::string &output){
+    std::vector<std::string> names;
+    // keycode -> table index + 1, in pages of 256
+    std::vector<std::vector<unsigned>> pages(256);
+    for(unsigned i = 0; i < keycode_table_size; ++i){
+        const KeycodeEntry &entry = keycode_table[i];
+        if(std::find(names.begin(), names.end(), entry.name) != names.end()){
+            std::cerr << "gentables: duplicate keycode name " << entry.name << std::endl;
+            return 1;
+        }
+        names.push_back(entry.name);
+
+        auto &page = pages[entry.keycode >> 8];
+        if(page.empty())
+            page.resize(256, 0);
+        if(page[entry.keycode & 0xFF])
+            std::cerr << "gentables: duplicate keycode " << entry.name << std::endl;
+        // last entry wins
+        page[entry.keycode & 0xFF] = i + 1;
+    }
+
+    std::ostringstream out;
+    out << "// Generated by gentables from keycode_table.h, do not edit.\n\n";
+
+    // page 0 of the page table is left empty for unused pages
+    std::vector<unsigned> page_index(256, 0);
+    std::vector<const std::vector<unsigned> *> used;
+    for(size_t p = 0; p < pages.size(); ++p){
+        if(!pages[p].empty()){
+            used.push_back(&pages[p]);
+            page_index[p] = used.size();
+        }
+    }
+    out << "// Keycode lookup, index of page for high byte of keycode\n";
+    out << "static constexpr unsigned char keycode_pages[] = {";
+    for(size_t p = 0; p < page_index.size(); ++p)
+        out << (p % 16 ? " " : "\n    ") << page_index[p] << ",";
+    out << "\n};\n";
+    out << "// Table index + 1 for low byte of keycode, 0 is unknown\n";
+    out << "static constexpr unsigned short keycode_page_table[][256] = {\n";
+    out << "    { 0 },\n";
+    for(const auto *page : used){
+        out << "    {";
+        for(size_t k = 0; k < page->size(); ++k)
+            out << (k % 16 ? " " : "\n        ") << (*page)[k] << ",";
+        out << "\n    },\n";
+    }
+    out << "};\n\n";
+
+    out << "// Keycode name lookup, FNV-1a hash of name\n";
+    write_slots(out, "keycode_name_slots", hash_slots(names));
+
+    std::ofstream file(output);
+    file << out.str();
+    return file ? 0 : 1;
+}
+
+int main(int argc, char **argv){
+    if(argc < 3){
+        std::cerr << "Usage: gentables layouts <output> <input>..." << std::endl;
+        std::cerr << "       gentables keycodes <output>" << std::endl;
+        return 2;
+    }
+    std::string mode = argv[1];
+    std::string output = argv[2];
+    std::vector<std::string> inputs(argv + 3, argv + argc);
+
+    if(mode == "layouts")
+        return gen_layouts(output, inputs);
+    if(mode == "keycodes")
+        return gen_keycodes(output);
+
+    std::cerr << "gentables: unknown mode " << mode << std::endl;
+    return 2;
+}
@@ -1,19 +1,23 @@
 #include "keymap.h"
-#include "keycodes.h"
+#include "keymap_render.h"
+#include "keymap_snapshot.h"
+#include "layoutdir.h"
+#include "keycode_table.h"
 
 #include "zlog.h"
 #include "zmap.h"
 
-#define USE_NLOHMANN_JSON 1
+#include <sstream>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <atomic>
 
-#if USE_NLOHMANN_JSON
-    #include <nlohmann/json.hpp>
-#else
-    #include "zjson.h"
-#endif
+#include <nlohmann/json.hpp>
 
 // only include in this file
-#include "gen_keymaps.h"
+#include "gen_layouts.h"
+#include "gen_keycodes.h"
 
 #define MIN(A, B) (A < B ? A : B)
 #define MAX(A, B) (A > B ? A : B)
@@ -21,344 +25,117 @@
 #define LAYOUT_SP 0x80
 #define LAYOUT_MASK 0x3F
 
-const ZArray<Keymap::Keycode> keycodes = {
-    { KC_NO,                    "KC_NO",                    "",         "None" },
-    { KC_TRANSPARENT,           "KC_TRNS",                  "",         "Transparent (keycode from previous layer)" },
-    { KC_A,                     "KC_A",                     "A",        "A" },
-    { KC_B,                     "KC_B",                     "B",        "B" },
-    { KC_C,                     "KC_C",                     "C",        "C" },
-    { KC_D,                     "KC_D",                     "D",        "D" },
-    { KC_E,                     "KC_E",                     "E",        "E" },
-    { KC_F,                     "KC_F",                     "F",        "F" },
-    { KC_G,                     "KC_G",                     "G",        "G" },
-    { KC_H,                     "KC_H",                     "H",        "H" },
-    { KC_I,                     "KC_I",                     "I",        "I" },
-    { KC_J,                     "KC_J",                     "J",        "J" },
-    { KC_K,                     "KC_K",                     "K",        "K" },
-    { KC_L,                     "KC_L",                     "L",        "L" },
-    { KC_M,                     "KC_M",                     "M",        "M" },
-    { KC_N,                     "KC_N",                     "N",        "N" },
-    { KC_O,                     "KC_O",                     "O",        "O" },
-    { KC_P,                     "KC_P",                     "P",        "P" },
-    { KC_Q,                     "KC_Q",                     "Q",        "Q" },
-    { KC_R,                     "KC_R",                     "R",        "R" },
-    { KC_S,                     "KC_S",                     "S",        "S" },
-    { KC_T,                     "KC_T",                     "T",        "T" },
-    { KC_U,                     "KC_U",                     "U",        "U" },
-    { KC_V,                     "KC_V",                     "V",        "V" },
-    { KC_W,                     "KC_W",                     "W",        "W" },
-    { KC_X,                     "KC_X",                     "X",        "X" },
-    { KC_Y,                     "KC_Y",                     "Y",        "Y" },
-    { KC_Z,                     "KC_Z",                     "Z",        "Z" },
-    { KC_1,                     "KC_1",                     "1",        "1" },
-    { KC_2,                     "KC_2",                     "2",        "2" },
-    { KC_3,                     "KC_3",                     "3",        "3" },
-    { KC_4,                     "KC_4",                     "4",        "4" },
-    { KC_5,                     "KC_5",                     "5",        "5" },
-    { KC_6,                     "KC_6",                     "6",        "6" },
-    { KC_7,                     "KC_7",                     "7",        "7" },
-    { KC_8,                     "KC_8",                     "8",        "8" },
-    { KC_9,                     "KC_9",                     "9",        "9" },
-    { KC_0,                     "KC_0",                     "0",        "0" },
-    { KC_ENTER,                 "KC_ENTER",                 "ENTER",    "Enter" },
-    { KC_ESCAPE,                "KC_ESCAPE",                "ESC",      "Esc" },
-    { KC_BSPACE,                "KC_BSPACE",                "BSPACE",   "Backspace" },
-    { KC_TAB,                   "KC_TAB",                   "TAB",      "Tab" },
-    { KC_SPACE,                 "KC_SPACE",                 "SPACE",    "Space" },
-    { KC_MINUS,                 "KC_MINUS",                 "-",        "-" },
-    { KC_EQUAL,                 "KC_EQUAL",                 "=",        "=" },
-    { KC_LBRACKET,              "KC_LBRACKET",              "[",        "[" },
-    { KC_RBRACKET,              "KC_RBRACKET",              "]",        "]" },
-    { KC_BSLASH,                "KC_BSLASH",                "\\",       "\\" },
-    { KC_NONUS_HASH,            "KC_NONUS_HASH",            "",         "# (Non-US)" },
-    { KC_SCOLON,                "KC_SCOLON",                ";",        ";" },
-    { KC_QUOTE,                 "KC_QUOTE",                 "'",        "'" },
-    { KC_GRAVE,                 "KC_GRAVE",                 "`",        "`" },
-    { KC_COMMA,                 "KC_COMMA",                 ",",        "," },
-    { KC_DOT,                   "KC_DOT",                   ".",        "." },
-    { KC_SLASH,                 "KC_SLASH",                 "/",        "/" },
-    { KC_CAPSLOCK,              "KC_CAPSLOCK",              "CAPS",     "Caps Lock" },
-    { KC_F1,                    "KC_F1",                    "F1",       "F1" },
-    { KC_F2,                    "KC_F2",                    "F2",       "F2" },
-    { KC_F3,                    "KC_F3",                    "F3",       "F3" },
-    { KC_F4,                    "KC_F4",                    "F4",       "F4" },
-    { KC_F5,                    "KC_F5",                    "F5",       "F5" },
-    { KC_F6,                    "KC_F6",                    "F6",       "F6" },
-    { KC_F7,                    "KC_F7",                    "F7",       "F7" },
-    { KC_F8,                    "KC_F8",                    "F8",       "F8" },
-    { KC_F9,                    "KC_F9",                    "F9",       "F9" },
-    { KC_F10,                   "KC_F10",                   "F10",      "F10" },
-    { KC_F11,                   "KC_F11",                   "F11",      "F11" },
-    { KC_F12,                   "KC_F12",                   "F12",      "F12" },
-    { KC_PSCREEN,               "KC_PSCREEN",               "PRSC",     "Print Screen" },
-    { KC_SCROLLLOCK,            "KC_SCROLLLOCK",            "SCLK",     "Scroll Lock" },
-    { KC_PAUSE,                 "KC_PAUSE",                 "PAUS",     "Pause" },
-    { KC_INSERT,                "KC_INSERT",                "INS",      "Insert" },
-    { KC_HOME,                  "KC_HOME",                  "HOME",     "Home" },
-    { KC_PGUP,                  "KC_PGUP",                  "PGUP",     "Page Up" },
-    { KC_DELETE,                "KC_DELETE",                "DEL",      "Delete" },
-    { KC_END,                   "KC_END",                   "END",      "End" },
-    { KC_PGDOWN,                "KC_PGDOWN",                "PGDN",     "Page Down" },
-    { KC_RIGHT,                 "KC_RIGHT",                 "RIGHT",    "Right Arrow" },
-    { KC_LEFT,                  "KC_LEFT",                  "LEFT",     "Left Arrow" },
-    { KC_DOWN,                  "KC_DOWN",                  "DOWN",     "Down Arrow" },
-    { KC_UP,                    "KC_UP",                    "UP",       "Up Arrow" },
-    { KC_NUMLOCK,               "KC_NUMLOCK",               "NUMLK",    "Number Lock" },
-    { KC_KP_SLASH,              "KC_KP_SLASH",              "/",        "Keypad /" },
-    { KC_KP_ASTERISK,           "KC_KP_ASTERISK",           "*",        "Keypad *" },
-    { KC_KP_MINUS,              "KC_KP_MINUS",              "-",        "Keypad -" },
-    { KC_KP_PLUS,               "KC_KP_PLUS",               "+",        "Keypad +" },
-    { KC_KP_ENTER,              "KC_KP_ENTER",              "ENTER",    "Keypad Enter" },
-    { KC_KP_1,                  "KC_KP_1",                  "1",        "Keypad 1" },
-    { KC_KP_2,                  "KC_KP_2",                  "2",        "Keypad 2" },
-    { KC_KP_3,                  "KC_KP_3",                  "3",        "Keypad 3" },
-    { KC_KP_4,                  "KC_KP_4",                  "4",        "Keypad 4" },
-    { KC_KP_5,                  "KC_KP_5",                  "5",        "Keypad 5" },
-    { KC_KP_6,                  "KC_KP_6",                  "6",        "Keypad 6" },
-    { KC_KP_7,                  "KC_KP_7",                  "7",        "Keypad 7" },
-    { KC_KP_8,                  "KC_KP_8",                  "8",        "Keypad 8" },
-    { KC_KP_9,                  "KC_KP_9",                  "9",        "Keypad 9" },
-    { KC_KP_0,                  "KC_KP_0",                  "0",        "Keypad 0" },
-    { KC_KP_DOT,                "KC_KP_DOT",                ".",        "Keypad ." },
-    { KC_NONUS_BSLASH,          "KC_NONUS_BSLASH",          "\\",       "\\ (Non-US)" },
-    { KC_APPLICATION,           "KC_APPLICATION",           "APP",      "Application Menu" },
-//  { KC_POWER,                 "KC_POWER",                 "POWER",    "Power" },
-    { KC_KP_EQUAL,              "KC_KP_EQUAL",              "=",        "Keypad =" },
-    { KC_F13,                   "KC_F13",                   "F13",      "F13" },
-    { KC_F14,                   "KC_F14",                   "F14",      "F14" },
-    { KC_F15,                   "KC_F15",                   "F15",      "F15" },
-    { KC_F16,                   "KC_F16",                   "F16",      "F16" },
-    { KC_F17,                   "KC_F17",                   "F17",      "F17" },
-    { KC_F18,                   "KC_F18",                   "F18",      "F18" },
-    { KC_F19,                   "KC_F19",                   "F19",      "F19" },
-    { KC_F20,                   "KC_F20",                   "F20",      "F20" },
-    { KC_F21,                   "KC_F21",                   "F21",      "F21" },
-    { KC_F22,                   "KC_F22",                   "F22",      "F22" },
-    { KC_F23,                   "KC_F23",                   "F23",      "F23" },
-    { KC_F24,                   "KC_F24",                   "F24",      "F24" },
-    { KC_EXECUTE,               "KC_EXECUTE",               "EXEC",     "Execute" },
-    { KC_HELP,                  "KC_HELP",                  "HELP",     "Help" },
-    { KC_MENU,                  "KC_MENU",                  "MENU",     "Menu" },
-    { KC_SELECT,                "KC_SELECT",                "SELECT",   "Select" },
-    { KC_STOP,                  "KC_STOP",                  "STOP",     "Stop" },
-    { KC_AGAIN,                 "KC_AGAIN",                 "AGAIN",    "Again" },
-    { KC_UNDO,                  "KC_UNDO",                  "UNDO",     "Undo" },
-    { KC_CUT,                   "KC_CUT",                   "CUT",      "Cut" },
-    { KC_COPY,                  "KC_COPY",                  "COPY",     "Copy" },
-    { KC_PASTE,                 "KC_PASTE",                 "PASTE",    "Paste" },
-    { KC_FIND,                  "KC_FIND",                  "FIND",     "Find" },
-    // not sure about these ys compared to media keys
-//  { KC__MUTE,                 "KC__MUTE",                 "MUTE",     "Mute" },
-//  { KC__VOLUP,                "KC__VOLUP",                "VOLUP",    "Volume Up" },
-//  { KC__VOLDOWN,              "KC__VOLDOWN",              "VOLDN",    "Volume Down" },
-    // these require specialandling on keyboard and OS
-//  { KC_LOCKING_CAPS,          "KC_LOCKING_CAPS",          "LKCAPS",   "Locking Caps Lock" },
-//  { KC_LOCKING_NUM,           "KC_LOCKING_NUM",           "LKNUM",    "Locking Num Lock" },
-//  { KC_LOCKING_SCROLL,        "KC_LOCKING_SCROLL",        "LKSCLK",   "Locking Scroll Lock" },
-    { KC_KP_COMMA,              "KC_KP_COMMA",              ",",        "Keypad ," },
-//  { KC_KP_EQUAL_AS400,        "KC_KP_EQUAL_AS400",        "=",        "Keypad AS400 Equal" },
-    { KC_INT1,                  "KC_INT1",                  "INT1",     "International 1" },
-    { KC_INT2,                  "KC_INT2",                  "INT2",     "International 2" },
-    { KC_INT3,                  "KC_INT3",                  "INT3",     "International 3" },
-    { KC_INT4,                  "KC_INT4",                  "INT4",     "International 4" },
-    { KC_INT5,                  "KC_INT5",                  "INT5",     "International 5" },
-    { KC_INT6,                  "KC_INT6",                  "INT6",     "International 6" },
-    { KC_INT7,                  "KC_INT7",                  "INT7",     "International 7" },
-    { KC_INT8,                  "KC_INT8",                  "INT8",     "International 8" },
-    { KC_INT9,                  "KC_INT9",                  "INT9",     "International 9" },
-    { KC_LANG1,                 "KC_LANG1",                 "LANG1",    "Language Specific 1" },
-    { KC_LANG2,                 "KC_LANG2",                 "LANG2",    "Language Specific 2" },
-    { KC_LANG3,                 "KC_LANG3",                 "LANG3",    "Language Specific 3" },
-    { KC_LANG4,                 "KC_LANG4",                 "LANG4",    "Language Specific 4" },
-    { KC_LANG5,                 "KC_LANG5",                 "LANG5",    "Language Specific 5" },
-    { KC_LANG6,                 "KC_LANG6",                 "LANG6",    "Language Specific 6" },
-    { KC_LANG7,                 "KC_LANG7",                 "LANG7",    "Language Specific 7" },
-    { KC_LANG8,                 "KC_LANG8",                 "LANG8",    "Language Specific 8" },
-    { KC_LANG9,                 "KC_LANG9",                 "LANG9",    "Language Specific 9" },
-    { KC_ALT_ERASE,             "KC_ALT_ERASE",             "ALTERA",   "Alternate Erase" },
-    { KC_SYSREQ,                "KC_SYSREQ",                "SYSREQ",   "SysReq" },
-    { KC_CANCEL,                "KC_CANCEL",                "CANCEL",   "Cancel" },
-    { KC_CLEAR,                 "KC_CLEAR",                 "CLEAR",    "Clear" },
-    { KC_PRIOR,                 "KC_PRIOR",                 "PRIOR",    "Prior" },
-    { KC_RETURN,                "KC_RETURN",                "RETURN",   "Return" },
-    { KC_SEPARATOR,             "KC_SEPARATOR",             "SEP",      "Separator" },
-    { KC_OUT,                   "KC_OUT",                   "OUT",      "Out" },
-    { KC_OPER,                  "KC_OPER",                  "OPER",     "Oper" },
-    { KC_CLEAR_AGAIN,           "KC_CLEAR_AGAIN",           "CLRAG",    "Clear Again" },
-    { KC_CRSEL,                 "KC_CRSEL",                 "CRSEL",    "CrSel" },
-    { KC_EXSEL,                 "KC_EXSEL",                 "EXSEL",    "ExSel" },
-
-    // Keypad codes (0xB0-0xDD) not used
-
-    { KC_LCTRL,                 "KC_LCTRL",                 "LCTRL",    "Left Control" },
-    { KC_LSHIFT,                "KC_LSHIFT",                "LSHIFT",   "Left Shift" },
-    { KC_LALT,                  "KC_LALT",                  "LALT",     "Left Alt" },
-    { KC_LGUI,                  "KC_LGUI",                  "LGUI",     "Left GUI" },
-    { KC_RCTRL,                 "KC_RCTRL",                 "RCTRL",    "Right Control" },
-    { KC_RSHIFT,                "KC_RSHIFT",                "RSHIFT",   "Right Shift" },
-    { KC_RALT,                  "KC_RALT",                  "RALT",     "Right Alt" },
-    { KC_RGUI,                  "KC_RGUI",                  "RGUI",     "Right GUI" },
-
-    { KC_SYSTEM_POWER,          "KC_SYSTEM_POWER",          "POWER",    "System Power" },
-    { KC_SYSTEM_SLEEP,          "KC_SYSTEM_SLEEP",          "SLEEP",    "System Sleep" },
-    { KC_SYSTEM_WAKE,           "KC_SYSTEM_WAKE",           "WAKE",     "System Wake" },
-    { KC_AUDIO_MUTE,            "KC_AUDIO_MUTE",            "MUTE",     "Audio Mute" },
-    { KC_AUDIO_VOL_UP,          "KC_AUDIO_VOL_UP",          "VOLUP",    "Audio Volume Up" },
-    { KC_AUDIO_VOL_DOWN,        "KC_AUDIO_VOL_DOWN",        "VOLDN",    "Audio Volume Down" },
-    { KC_MEDIA_NEXT_TRACK,      "KC_MEDIA_NEXT_TRACK",      "MNEXT",    "Media Next Track" },
-    { KC_MEDIA_PREV_TRACK,      "KC_MEDIA_PREV_TRACK",      "MPREV",    "Media Previous Track" },
-    { KC_MEDIA_STOP,            "KC_MEDIA_STOP",            "MSTOP",    "Media Stop" },
-    { KC_MEDIA_PLAY_PAUSE,      "KC_MEDIA_PLAY_PAUSE",      "MPLAY",    "Media Play/Pause" },
-    { KC_MEDIA_SELECT,          "KC_MEDIA_SELECT",          "MSEL",     "Media Select" },
-    { KC_MEDIA_EJECT,           "KC_MEDIA_EJECT",           "MEJECT",   "Media Eject" },
-    { KC_MAIL,                  "KC_MAIL",                  "MAIL",     "Mail" },
-    { KC_CALCULATOR,            "KC_CALCULATOR",            "CALC",     "Calculator" },
-    { KC_MY_COMPUTER,           "KC_MY_COMPUTER",           "COMP",     "My Computer" },
-    { KC_WWW_SEARCH,            "KC_WWW_SEARCH",            "SEARCH",   "WWW Search" },
-    { KC_WWW_HOME,              "KC_WWW_HOME",              "WHOME",    "WWW Home" },
-    { KC_WWW_BACK,              "KC_WWW_BACK",              "WBACK",    "WWW Back" },
-    { KC_WWW_FORWARD,           "KC_WWW_FORWARD",           "WFOR",     "WWW Forward" },
-    { KC_WWW_STOP,              "KC_WWW_STOP",              "WSTOP",    "WWW Stop" },
-    { KC_WWW_REFRESH,           "KC_WWW_REFRESH",           "WREFR",    "WWW Refresh" },
-    { KC_WWW_FAVORITES,         "KC_WWW_FAVORITES",         "WFAV",     "WWW Favorites" },
-    { KC_MEDIA_FAST_FORWARD,    "KC_MEDIA_FAST_FORWARD",    "MFASTF",   "Media Fast Forward" },
-    { KC_MEDIA_REWIND,          "KC_MEDIA_REWIND",          "MREW",     "Media Rewind" },
-
-    { KC_MS_UP,                 "KC_MS_UP",                 "MSUP",     "Mouse Up" },
-    { KC_MS_DOWN,               "KC_MS_DOWN",               "MSDOWN",   "Mouse Down" },
-    { KC_MS_LEFT,               "KC_MS_LEFT",               "MSLEFT",   "Mouse Left" },
-    { KC_MS_RIGHT,              "KC_MS_RIGHT",              "MSRGHT",   "Mouse Right" },
-    { KC_MS_BTN1,               "KC_MS_BTN1",               "MSBTN1",   "Mouse Button 1" },
-    { KC_MS_BTN2,               "KC_MS_BTN2",               "MSBTN2",   "Mouse Button 2" },
-    { KC_MS_BTN3,               "KC_MS_BTN3",               "MSBTN3",   "Mouse Button 3" },
-    { KC_MS_BTN4,               "KC_MS_BTN4",               "MSBTN4",   "Mouse Button 4" },
-    { KC_MS_BTN5,               "KC_MS_BTN5",               "MSBTN5",   "Mouse Button 5" },
-    { KC_MS_WH_UP,              "KC_MS_WH_UP",              "WHUP",     "Mouse Wheel Up" },
-    { KC_MS_WH_DOWN,            "KC_MS_WH_DOWN",            "WHDOWN",   "Mouse Wheel Down" },
-    { KC_MS_WH_LEFT,            "KC_MS_WH_LEFT",            "WHLEFT",   "Mouse Wheel Left" },
-    { KC_MS_WH_RIGHT,           "KC_MS_WH_RIGHT",           "WHRGHT",   "Mouse Wheel Right" },
-    { KC_MS_ACCEL0,             "KC_MS_ACCEL0",             "MSACC0",   "Mouse Acceleration 0" },
-    { KC_MS_ACCEL1,             "KC_MS_ACCEL1",             "MSACC1",   "Mouse Acceleration 1" },
-    { KC_MS_ACCEL2,             "KC_MS_ACCEL2",             "MSACC2",   "Mouse Acceleration 2" },
-
-    { MO(0),                    "MO(0)",                    "MO(0)",    "Momentary Layer 0" },
-    { MO(1),                    "MO(1)",                    "MO(1)",    "Momentary Layer 1" },
-    { MO(2),                    "MO(2)",                    "MO(2)",    "Momentary Layer 2" },
-    { MO(3),                    "MO(3)",                    "MO(3)",    "Momentary Layer 3" },
-    { MO(4),                    "MO(4)",                    "MO(4)",    "Momentary Layer 4" },
-    { MO(5),                    "MO(5)",                    "MO(5)",    "Momentary Layer 5" },
-    { MO(6),                    "MO(6)",                    "MO(6)",    "Momentary Layer 6" },
-    { MO(7),                    "MO(7)",                    "MO(7)",    "Momentary Layer 7" },
-
-    { TG(0),                    "TG(0)",                    "TG(0)",    "Toggle Layer 0" },
-    { TG(1),                    "TG(1)",                    "TG(1)",    "Toggle Layer 1" },
-    { TG(2),                    "TG(2)",                    "TG(2)",    "Toggle Layer 2" },
-    { TG(3),                    "TG(3)",                    "TG(3)",    "Toggle Layer 3" },
-    { TG(4),                    "TG(4)",                    "TG(4)",    "Toggle Layer 4" },
-    { TG(5),                    "TG(5)",                    "TG(5)",    "Toggle Layer 5" },
-    { TG(6),                    "TG(6)",                    "TG(6)",    "Toggle Layer 6" },
-    { TG(7),                    "TG(7)",                    "TG(7)",    "Toggle Layer 7" },
-
-    { TT(0),                    "TT(0)",                    "TT(0)",    "Tap Toggle Layer 0" },
-    { TT(1),                    "TT(1)",                    "TT(1)",    "Tap Toggle Layer 1" },
-    { TT(2),                    "TT(2)",                    "TT(2)",    "Tap Toggle Layer 2" },
-    { TT(3),                    "TT(3)",                    "TT(3)",    "Tap Toggle Layer 3" },
-    { TT(4),                    "TT(4)",                    "TT(4)",    "Tap Toggle Layer 4" },
-    { TT(5),                    "TT(5)",                    "TT(5)",    "Tap Toggle Layer 5" },
-    { TT(6),                    "TT(6)",                    "TT(6)",    "Tap Toggle Layer 6" },
-    { TT(7),                    "TT(7)",                    "TT(7)",    "Tap Toggle Layer 7" },
-
-    { DF(0),                    "DF(0)",                    "DF(0)",    "Set Default Layer 0" },
-    { DF(1),                    "DF(1)",                    "DF(1)",    "Set Default Layer 1" },
-    { DF(2),                    "DF(2)",                    "DF(2)",    "Set Default Layer 2" },
-    { DF(3),                    "DF(3)",                    "DF(3)",    "Set Default Layer 3" },
-    { DF(4),                    "DF(4)",                    "DF(4)",    "Set Default Layer 4" },
-    { DF(5),                    "DF(5)",                    "DF(5)",    "Set Default Layer 5" },
-    { DF(6),                    "DF(6)",                    "DF(6)",    "Set Default Layer 6" },
-    { DF(7),                    "DF(7)",                    "DF(7)",    "Set Default Layer 7" },
-
-    { RESET,                    "RESET",                    "RESET",    "Magic Reset" },
-    { DEBUG,                    "DEBUG",                    "DEBUG",    "Magic Debug" },
-
-//  { MAGIC_SWAP_CONTROL_CAPSLOCK,      "MAGIC_SWAP_CONTROL_CAPSLOCK",      "", "" },
-//  { MAGIC_CAPSLOCK_TO_CONTROL,        "MAGIC_CAPSLOCK_TO_CONTROL",        "", "" },
-//  { MAGIC_SWAP_LALT_LGUI,             "MAGIC_SWAP_LALT_LGUI",             "", "" },
-//  { MAGIC_SWAP_RALT_RGUI,             "MAGIC_SWAP_RALT_RGUI",             "", "" },
-//  { MAGIC_NO_GUI,                     "MAGIC_NO_GUI",                     "", "" },
-//  { MAGIC_SWAP_GRAVE_ESC,             "MAGIC_SWAP_GRAVE_ESC",             "", "" },
-//  { MAGIC_SWAP_BACKSLASH_BACKSPACE,   "MAGIC_SWAP_BACKSLASH_BACKSPACE",   "", "" },
-//  { MAGIC_HOST_NKRO,                  "MAGIC_HOST_NKRO",                  "", "" },
-//  { MAGIC_SWAP_ALT_GUI,               "MAGIC_SWAP_ALT_GUI",               "", "" },
-//  { MAGIC_UNSWAP_CONTROL_CAPSLOCK,    "MAGIC_UNSWAP_CONTROL_CAPSLOCK",    "", "" },
-//  { MAGIC_UNCAPSLOCK_TO_CONTROL,      "MAGIC_UNCAPSLOCK_TO_CONTROL",      "", "" },
-//  { MAGIC_UNSWAP_LALT_LGUI,           "MAGIC_UNSWAP_LALT_LGUI",           "", "" },
-//  { MAGIC_UNSWAP_RALT_RGUI,           "MAGIC_UNSWAP_RALT_RGUI",           "", "" },
-//  { MAGIC_UNNO_GUI,                   "MAGIC_UNNO_GUI",                   "", "" },
-//  { MAGIC_UNSWAP_GRAVE_ESC,           "MAGIC_UNSWAP_GRAVE_ESC",           "", "" },
-//  { MAGIC_UNSWAP_BACKSLASH_BACKSPACE, "MAGIC_UNSWAP_BACKSLASH_BACKSPACE", "", "" },
-//  { MAGIC_UNHOST_NKRO,                "MAGIC_UNHOST_NKRO",                "", "" },
-//  { MAGIC_UNSWAP_ALT_GUI,             "MAGIC_UNSWAP_ALT_GUI",             "", "" },
-//  { MAGIC_TOGGLE_NKRO,                "MAGIC_TOGGLE_NKRO",                "", "" },
-//  { GRAVE_ESC,                        "GRAVE_ESC",                        "", "" },
-
-    { BL_ON,                    "BL_ON",                    "BLON",     "Backlight On" },
-    { BL_OFF,                   "BL_OFF",                   "BLOFF",    "Backlight Off" },
-    { BL_DEC,                   "BL_DEC",                   "BLDEC",    "Backlight Decrease" },
-    { BL_INC,                   "BL_INC",                   "BLINC",    "Backlight Increase" },
-    { BL_TOGG,                  "BL_TOGG",                  "BLTOGG",   "Backlight Toggle" },
-    { BL_STEP,                  "BL_STEP",                  "BLSTEP",   "Backlight Step" },
-    { BL_BRTG,                  "BL_BRTG",                  "BLBRTG",   "Backlight " },
-
-    { RGB_TOG,                  "RGB_TOG",                  "RGBTOG",   "RGB Toggle" },
-    { RGB_MODE_FORWARD,         "RGB_MODE_FORWARD",         "RGBMDF",   "RGB Mode Forward" },
-    { RGB_MODE_REVERSE,         "RGB_MODE_REVERSE",         "RGBMDR",   "RGB Mode Reverse" },
-    { RGB_HUI,                  "RGB_HUI",                  "RGBHUI",   "RGB Hue Increase" },
-    { RGB_HUD,                  "RGB_HUD",                  "RGBHUD",   "RGB Hue Decrease" },
-    { RGB_SAI,                  "RGB_SAI",                  "RGBSAI",   "RGB Saturation Increase" },
-    { RGB_SAD,                  "RGB_SAD",                  "RGBSAD",   "RGB Saturation Decrease" },
-    { RGB_VAI,                  "RGB_VAI",                  "RGBVAI",   "RGB Value Increase" },
-    { RGB_VAD,                  "RGB_VAD",                  "RGBVAD",   "RGB Value Decrease" },
-    { RGB_MODE_PLAIN,           "RGB_MODE_PLAIN",           "RGBMP",    "RGB Mode Plain" },
-    { RGB_MODE_BREATHE,         "RGB_MODE_BREATHE",         "RGBMB",    "RGB Mode Breathe" },
-    { RGB_MODE_RAINBOW,         "RGB_MODE_RAINBOW",         "RGBMR",    "RGB Mode Rainbow" },
-    { RGB_MODE_SWIRL,           "RGB_MODE_SWIRL",           "RGBMSW",   "RGB Mode Swirl" },
-    { RGB_MODE_SNAKE,           "RGB_MODE_SNAKE",           "RGBMSN",   "RGB Mode Snake" },
-    { RGB_MODE_KNIGHT,          "RGB_MODE_KNIGHT",          "RGBMK",    "RGB Mode Knight" },
-    { RGB_MODE_XMAS,            "RGB_MODE_XMAS",            "RGBMX",    "RGB Mode XMas" },
-    { RGB_MODE_GRADIENT,        "RGB_MODE_GRADIENT",        "RGBMG",    "RGB Mode Gradient" },
-
-    { SAFE_RANGE+0,             "CUSTOM0",                  "CUST0",    "Custom 0" },
-    { SAFE_RANGE+1,             "CUSTOM1",                  "CUST1",    "Custom 1" },
-    { SAFE_RANGE+2,             "CUSTOM2",                  "CUST2",    "Custom 2" },
-    { SAFE_RANGE+3,             "CUSTOM3",                  "CUST3",    "Custom 3" },
-    { SAFE_RANGE+4,             "CUSTOM4",                  "CUST4",    "Custom 4" },
-    { SAFE_RANGE+5,             "CUSTOM5",                  "CUST5",    "Custom 5" },
-    { SAFE_RANGE+6,             "CUSTOM6",                  "CUST6",    "Custom 6" },
-    { SAFE_RANGE+7,             "CUSTOM7",                  "CUST7",    "Custom 7" },
-
-};
-
-ZMap<Keymap::keycode, Keymap::Keycode> kcode_map;
-ZMap<ZString, Keymap::keycode> kname_map;
-
-Keymap::Keymap(zu8 _rows, zu8 _cols) : rows(_rows), cols(_cols), nkeys(0){
-    // make keycode map
-    if(!kcode_map.size()){
-        for(zsize i = 0; i < keycodes.size(); ++i){
-            kcode_map[keycodes[i].keycode] = keycodes[i];
-            if(kname_map.contains(keycodes[i].name))
-                ELOG("Duplicate keycode name");
-            kname_map[keycodes[i].name] = keycodes[i].keycode;
+// FNV-1a, must match gentables
+static zu32 name_hash(const std::string &str){
+    zu32 hash = 2166136261u;
+    for(zu64 i = 0; i < str.size(); ++i){
+        hash ^= (zbyte)str[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Find compiled-in layout by name
+static const LayoutTable *findLayout(const ZString &name){
+    const std::string str = name.str();
+    zu32 slot = name_hash(str) & layout_name_slots_mask;
+    while(layout_name_slots[slot]){
+        const LayoutTable *table = &layout_tables[layout_name_slots[slot] - 1];
+        if(str == table->name)
+            return table;
+        slot = (slot + 1) & layout_name_slots_mask;
+    }
+    return nullptr;
+}
+
+// Find the key widths and row lengths of a runtime or compiled-in layout.
+// A runtime layout is kept in \a hold, which must outlive the returned pointers.
+static bool findLayoutKeys(const ZString &name, std::shared_ptr<const LayoutDirectory::Layout> &hold,
+                           const zu8 *&lwidths, const zu8 *&lrows, zu16 &nrows){
+    // search runtime layouts, then compiled-in layouts
+    hold = LayoutDirectory::global().find(name);
+    const LayoutDirectory::Layout *rlayout = hold.get();
+    if(rlayout){
+        lwidths = rlayout->keys.data();
+        lrows = rlayout->rows.data();
+        nrows = rlayout->rows.size();
+        return true;
+    }
+    const LayoutTable *table = findLayout(name);
+    if(!table)
+        return false;
+    lwidths = table->keys;
+    lrows = table->rows;
+    nrows = table->nrows;
+    return true;
+}
+
+// Check a layout map before loadLayoutKeys(), which asserts on a bad one
+static bool checkLayoutMap(const zu8 *lwidths, const zu8 *lrows, zu16 nrows, zu8 rows, zu8 cols, const zbyte *map){
+    zu32 lkeys = 0;
+    for(zu32 r = 0, i = 0; r < nrows; ++r){
+        for(zu32 j = 0; j < lrows[r]; ++j, ++i){
+            if(!(lwidths[i] & LAYOUT_SP))
+                lkeys++;
         }
     }
+
+    // matrix positions are stored in a byte
+    const zu32 knum = rows * cols;
+    if(!lkeys || !knum || knum > 256)
+        return false;
+    ZBinary seen;
+    seen.fill(0, knum);
+    zu32 count = 0;
+    for(zu32 i = 0; i < knum; ++i){
+        const zu8 lpos = map[i];
+        if(!lpos)
+            continue;
+        if(lpos > lkeys || lpos > knum || seen[lpos - 1])
+            return false;
+        seen[lpos - 1] = 1;
+        count++;
+    }
+    return count == lkeys;
+}
+
+// Find keycode table entry by keycode
+static inline const KeycodeEntry *findKeycode(Keymap::keycode kc){
+    const zu16 index = keycode_page_table[keycode_pages[kc >> 8]][kc & 0xFF];
+    return index ? &keycode_table[index - 1] : nullptr;
+}
+
+// Find keycode table entry by name
+static const KeycodeEntry *findKeycodeName(const ZString &name){
+    const std::string str = name.str();
+    zu32 slot = name_hash(str) & keycode_name_slots_mask;
+    while(keycode_name_slots[slot]){
+        const KeycodeEntry *entry = &keycode_table[keycode_name_slots[slot] - 1];
+        if(str == entry->name)
+            return entry;
+        slot = (slot + 1) & keycode_name_slots_mask;
+    }
+    return nullptr;
+}
+
+Keymap::Keymap(zu8 _rows, zu8 _cols) : rows(_rows), cols(_cols), nkeys(0), nlayers(0), tracking(false), sync_id(0){
+
 }
 
 void Keymap::loadLayout(ZString lname, ZBinary layout){
+    zassert(layout.size() == rows * cols, "Bad layout map size!");
+    std::shared_ptr<const LayoutDirectory::Layout> hold;
+    const zu8 *lwidths = nullptr;
+    const zu8 *lrows = nullptr;
+    zu16 nrows = 0;
+    zassert(findLayoutKeys(lname, hold, lwidths, lrows, nrows), "layout not known");
+    loadLayoutKeys(lname, layout.raw(), lwidths, lrows, nrows);
+}
+
+void Keymap::loadLayoutKeys(ZString lname, const zbyte *layout, const zu8 *lwidths, const zu8 *lrows, zu16 nrows){
     layout_name = lname;
 
     const int knum = rows * cols;
-    zassert(layout.size() == knum, "Bad layout map size!");
-
     matrix2layout.resize(knum);
     layout2matrix.resize(knum);
     for(zsize i = 0; i < knum; ++i){
@@ -366,69 +143,21 @@ void Keymap::loadLayout(ZString lname, ZBinary layout){
         layout2matrix[i] = 0;
     }
 
-    // search known layouts
-    bool found = false;
     zu16 lkeys = 0;
-    for(zu64 i = 0; i < keymaps_json_size / sizeof(unsigned); ++i){
-        zu64 len = keymaps_json_sizes[i];
-        ZString str(keymaps_json[i], len);
-
-    #if USE_NLOHMANN_JSON
-        auto json = nlohmann::json::parse(str.str());
-        ZString name = json["name"].get<std::string>();
-        if(name == layout_name){
-            auto j1 = json["layout"];
-            for(auto it = j1.cbegin(); it != j1.cend(); ++it){
-                auto j2 = *it;
-                for(auto jt = j2.cbegin(); jt != j2.cend(); ++jt){
-                    int width = *jt;
-                    Key k;
-                    k.width = width & LAYOUT_MASK;
-                    k.space = width & LAYOUT_SP;
-                    if(!k.space){
-                        lkeys++;
-                        lkmap[lkeys] = wlayout.size();
-                    }
-                    wlayout.push(k);
-                }
-                wlayout[wlayout.size() - 1].newrow = true;
-            }
-            found = true;
-            break;
-        }
-    #else
-        ZJSON json;
-        zassert(json.decode(str), "layout json decode");
-        zassert(json.type() == ZJSON::OBJECT, "layout json object");
-        zassert(json.object().contains("name"), "layout json name");
-        zassert(json["name"].type() == ZJSON::STRING, "layout json name type");
-        ZString name = json["name"].string();
-        if(name == layout_name){
-            zassert(json.object().contains("layout"), "layout json layout");
-            zassert(json["layout"].type() == ZJSON::ARRAY, "layout json layout type");
-            for(auto it = json["layout"].array().begin(); it.more(); ++it){
-                zassert(it.get().type() == ZJSON::ARRAY, "bad layout row type");
-                zassert(it.get().array().size(), "empty layout row");
-                for(auto jt = it.get().array().begin(); jt.more(); ++jt){
-                    zassert(jt.get().type() == ZJSON::NUMBER, "bad layout key type");
-                    int width = jt.get().number();
-                    Key k;
-                    k.width = width & LAYOUT_MASK;
-                    k.space = width & LAYOUT_SP;
-                    if(!k.space){
-                        lkeys++;
-                        lkmap[lkeys] = wlayout.size();
-                    }
-                    wlayout.push(k);
-                }
-                wlayout[wlayout.size() - 1].newrow = true;
+    for(zu16 r = 0, i = 0; r < nrows; ++r){
+        for(zu16 j = 0; j < lrows[r]; ++j, ++i){
+            int width = lwidths[i];
+            Key k;
+            k.width = width & LAYOUT_MASK;
+            k.space = width & LAYOUT_SP;
+            if(!k.space){
+                lkeys++;
+                lkmap[lkeys] = wlayout.size();
             }
-            found = true;
-            break;
+            wlayout.push(k);
         }
-#endif
+        wlayout[wlayout.size() - 1].newrow = true;
     }
-    zassert(found, "layout not known");
 
     // layout is a matrix, with each key given an index
     // numbered left to right, wrapping rows
@@ -436,7 +165,7 @@ void Keymap::loadLayout(ZString lname, ZBinary layout){
     for(zsize i = 0, r = 0; r < rows; ++r){
         for(zsize c = 0; c < cols; ++c, ++i){
             const zu8 mpos = i;
-            const zu8 lpos = layout.readu8();
+            const zu8 lpos = layout[i];
             if(lpos){
                 zassert(matrix2layout[mpos] == 0, "duplicate matrix index");
                 zassert(layout2matrix[lpos - 1] == 0, "duplicate layout index");
@@ -452,6 +181,10 @@ void Keymap::loadLayout(ZString lname, ZBinary layout){
     wlayout.resize(nkeys);
     wlayout[nkeys - 1].newrow = true;
 
+    // index rows for position lookups
+    row_start.clear();
+    row_width.clear();
+    row_start.push(0);
     zu16 rwmax = 0;
     int rwidth = 0;
     for(zsize i = 0; i < nkeys; ++i){
@@ -459,33 +192,98 @@ void Keymap::loadLayout(ZString lname, ZBinary layout){
         rwidth += keyw;
         if(wlayout[i].newrow){
             rwmax = MAX(rwmax, rwidth);
+            row_start.push(i + 1);
+            row_width.push(rwidth);
             rwidth = 0;
         }
     }
     mwidth = rwmax;
+
+    // matrix position of each key
+    key_matrix.resize(nkeys);
+    for(zsize i = 0; i < nkeys; ++i){
+        if(wlayout[i].row < rows && wlayout[i].col < cols)
+            key_matrix[i] = (wlayout[i].row * cols) + wlayout[i].col;
+        else
+            key_matrix[i] = 0xFFFF;
+    }
 }
 
 void Keymap::loadLayerMap(ZBinary layer){
+    zassert(layer.size() == (rows * cols * 2), "Bad layer map size!");
+    loadLayerMatrix(layer.raw());
+}
+
+void Keymap::loadLayerMatrix(const zbyte *layer){
     const int knum = rows * cols;
-    zassert(layer.size() == (knum * 2), "Bad layer map size!");
-    ZArray<keycode> keymap;
-    keymap.resize(nkeys);
+    const zu64 base = layer_keys.size();
+    layer_keys.resize(base + nkeys);
 
     for(zsize i = 0; i < knum; ++i){
-        keycode kc = layer.readleu16();
         zu8 kp = matrix2layout[i];
         if(kp){
-            keymap[kp - 1] = kc;
+            layer_keys[base + kp - 1] = ZBinary::decleu16(layer + (i * sizeof(keycode)));
         }
     }
-    layers.push(keymap);
+
+    // unmapped matrix positions are zero
+    const zu64 mbase = matrix.size();
+    matrix.resize(mbase + knum * sizeof(keycode));
+    memset(matrix.raw() + mbase, 0, knum * sizeof(keycode));
+    for(zsize i = 0; i < nkeys; ++i){
+        if(key_matrix[i] != 0xFFFF)
+            ZBinary::encleu16(matrix.raw() + mbase + key_matrix[i] * sizeof(keycode), layer_keys[base + i]);
+    }
+
+    nlayers++;
+
+    // changes are unknown until clearDirty()
+    dirty_cells.resize(nlayers * knum);
+    memset(dirty_cells.raw() + (nlayers - 1) * knum, 0, knum);
+    tracking = false;
+}
+
+void Keymap::set(zu8 l, zu16 k, keycode kc){
+    layer_keys[(l * nkeys) + k] = kc;
+    if(key_matrix[k] != 0xFFFF){
+        const zu32 cell = (l * rows * cols) + key_matrix[k];
+        ZBinary::encleu16(matrix.raw() + (cell * sizeof(keycode)), kc);
+        if(!dirty_cells.raw()[cell]){
+            dirty_cells.raw()[cell] = 1;
+            dirty.push(cell);
+        }
+    }
+}
+
+bool Keymap::dirtyOffsets(ZArray<zu32> &offsets) const {
+    if(!tracking)
+        return false;
+    // walk the cell flags, so the offsets come out sorted
+    offsets.clear();
+    if(!dirty.size())
+        return true;
+    for(zu32 cell = 0; cell < dirty_cells.size(); ++cell){
+        if(dirty_cells.raw()[cell])
+            offsets.push(cell * sizeof(keycode));
+    }
+    return true;
+}
+
+void Keymap::clearDirty(){
+    static std::atomic<zu64> next_sync(0);
+    for(zsize i = 0; i < dirty.size(); ++i)
+        dirty_cells.raw()[dirty[i]] = 0;
+    dirty.clear();
+    tracking = true;
+    sync_id = ++next_sync;
 }
 
 ZArray<ZArray<Keymap::keycode> > Keymap::getKeycodeLayout(zu8 l) const {
     ZArray<ZArray<keycode>> keymap;
     ZArray<keycode> layer;
+    const keycode *keys = layerKeys(l);
     for(zsize i = 0; i < nkeys; ++i){
-        layer.push(layers[l][i]);
+        layer.push(keys[i]);
         if(wlayout[i].newrow){
             keymap.push(layer);
             layer.clear();
@@ -494,133 +292,59 @@ ZArray<ZArray<Keymap::keycode> > Keymap::getKeycodeLayout(zu8 l) const {
     return keymap;
 }
 
-ZBinary Keymap::toMatrix() const {
-    ZBinary matrices;
-
-    for(zsize l = 0; l < layers.size(); ++l){
-        zu16 matrix[rows][cols];
-        memset(matrix, 0, sizeof(matrix));
-
-        // Put keycodes in matrix
-        for(zsize i = 0; i < nkeys; ++i){
-            const zu16 kc = layers[l][i];
-            matrix[wlayout[i].row][wlayout[i].col] = kc;
-        }
-
-        // Serialize matrix
-        for(zsize r = 0; r < rows; ++r){
-            for(zsize c = 0; c < cols; ++c){
-                matrices.writeleu16(matrix[r][c]);
-            }
-        }
-    }
-
-    return matrices;
+void Keymap::toMatrix(ZBinary &out) const {
+    out.resize(matrix.size());
+    memcpy(out.raw(), matrix.raw(), matrix.size());
 }
 
 void Keymap::printLayers() const{
-    for(zsize l = 0; l < layers.size(); ++l){
-        bool blank = true;
-        for(zsize i = 0; i < nkeys; ++i){
-            if(layers[l][i] != KC_NO){
-                blank = false;
-                break;
-            }
-        }
-
-        if(blank){
+    KeymapRenderer renderer(KeymapRenderer::TEXT);
+    for(zsize l = 0; l < nlayers; ++l){
+        if(KeymapRenderer::isBlank(*this, l)){
             LOG("Layer " << l << ": BLANK");
         } else {
             LOG("Layer " << l << ":");
-            ZString lstr;
-            if(mwidth){
-                lstr += ZString('=', (mwidth*2)+1);
-                lstr += "\n|";
-            }
-            for(zsize i = 0; i < nkeys; ++i){
-                const zu16 kc = layers[l][i];
-                const zu8 width = wlayout[i].width;
-                ZString kstr;
-                if(width){
-                    ZString str = keycodeAbbrev(kc);
-                    kstr += ZString(str).substr(0, str.size()/2).lpad(' ', width-1);
-                    kstr += ZString(str).substr(str.size()/2).rpad(' ', width+1);
-                    kstr.last() = '|';
-                } else {
-                    ZString str = keycodeName(kc);
-                    kstr += (str + ", ");
-                }
-                lstr += kstr;
-                if(wlayout[i].newrow){
-                    if(mwidth){
-                        lstr += "\n";
-                        lstr += ZString('=', (mwidth*2)+1);
-                        if(i < (nkeys-1))
-                            lstr += "\n|";
-                    }
-                }
-            }
-            RLOG(lstr << ZLog::NEWLN);
+            renderer.clear();
+            renderer.renderLayer(*this, l);
+            RLOG(ZString(renderer.str()) << ZLog::NEWLN);
         }
     }
 }
 
 void Keymap::printMatrix() const {
-    LOG("Matrix Dump: " << rows << "/" << cols << " r/c, " << layers.size() << " layers");
-
-    for(zsize l = 0; l < layers.size(); ++l){
-        zu16 matrix[rows][cols];
-        memset(matrix, 0, sizeof(matrix));
-
-        for(zsize i = 0; i < nkeys; ++i){
-            const zu16 kc = layers[l][i];
-            matrix[wlayout[i].row][wlayout[i].col] = kc;
-        }
+    LOG("Matrix Dump: " << rows << "/" << cols << " r/c, " << nlayers << " layers");
 
+    KeymapRenderer renderer(KeymapRenderer::MATRIX);
+    for(zsize l = 0; l < nlayers; ++l){
         LOG("Layer " << l << ":");
-
-        RLOG("{" << ZLog::NEWLN);
-        for(zsize r = 0; r < rows; ++r){
-            ZString line = "  { ";
-            for(zsize c = 0; c < cols; ++c){
-                line += (ZString(keycodeName(matrix[r][c]) + ",").pad(' ', 20) + " ");
-            }
-            line += "},";
-            RLOG(line << ZLog::NEWLN);
-        }
-        RLOG("}" << ZLog::NEWLN);
+        renderer.clear();
+        renderer.renderLayer(*this, l);
+        RLOG(ZString(renderer.str()));
     }
 }
 
 ZArray<int> Keymap::getLayer(zu8 layer) const {
     ZArray<int> keymap;
-    for(zsize i = 0; i < layers[layer].size(); ++i){
-        keymap.push(layers[layer][i]);
+    const keycode *keys = layerKeys(layer);
+    for(zsize i = 0; i < nkeys; ++i){
+        keymap.push(keys[i]);
     }
     return keymap;
 }
 
 ZArray<ZString> Keymap::getLayerAbbrev(zu8 layer) const {
     ZArray<ZString> keymap;
-    for(zsize i = 0; i < layers[layer].size(); ++i){
-        keymap.push(keycodeAbbrev(layers[layer][i]));
+    const keycode *keys = layerKeys(layer);
+    for(zsize i = 0; i < nkeys; ++i){
+        keymap.push(keycodeAbbrev(keys[i]));
     }
     return keymap;
 }
 
 zu16 Keymap::rowCount(zu8 row) const{
-    zu8 r = 0;
-    zu16 width = 0;
-    for(zsize i = 0; i < nkeys; ++i){
-        width += wlayout[i].width;
-        if(wlayout[i].newrow){
-            if(r == row)
-                return width;
-            width = 0;
-            r++;
-        }
-    }
-    return width;
+    if(row < row_width.size())
+        return row_width[row];
+    return 0;
 }
 
 ZArray<int> Keymap::getLayout() const {
@@ -634,17 +358,8 @@ ZArray<int> Keymap::getLayout() const {
 }
 
 zu16 Keymap::layoutRC2K(zu8 r, zu8 c) const {
-    zu8 row = 0;
-    zu8 col = 0;
-    for(zsize i = 0; i < nkeys; ++i){
-        if(row == r && col == c)
-            return i;
-        col++;
-        if(wlayout[i].newrow){
-            row++;
-            col = 0;
-        }
-    }
+    if(r < row_width.size() && c < row_start[r + 1] - row_start[r])
+        return row_start[r] + c;
     return 0xFFFF;
 }
 
@@ -655,33 +370,210 @@ zu16 Keymap::keyOffset(zu8 l, zu16 k) const {
     return ((lsize * l) + ((row * cols) + col)) * sizeof(zu16);
 }
 
-Keymap::keycode Keymap::toKeycode(ZString name) const {
-    if(kname_map.contains(name)){
-        return kname_map[name];
-    } else {
-        return KC_NO;
+// Parse an unsigned decimal or 0x-prefixed hex number
+static bool parse_uint(const std::string &str, zu32 &num){
+    if(str.empty() || str[0] == '-' || str[0] == '+')
+        return false;
+    char *end = nullptr;
+    errno = 0;
+    unsigned long long val = strtoull(str.c_str(), &end, 0);
+    if(*end != 0 || errno == ERANGE || val > 0xFFFFFFFF)
+        return false;
+    num = val;
+    return true;
+}
+
+// Read a non-negative JSON integer
+static bool json_uint(const nlohmann::json &json, zu32 &num){
+    if(!json.is_number_unsigned())
+        return false;
+    zu64 val = json.get<zu64>();
+    if(val > 0xFFFFFFFF)
+        return false;
+    num = val;
+    return true;
+}
+
+// Key number of a layout row and column, out of range if there is no such key
+static zu32 edit_key(const Keymap &keymap, zu32 row, zu32 col){
+    if(row > 0xFF || col > 0xFF)
+        return 0xFFFF;
+    return keymap.layoutRC2K(row, col);
+}
+
+// Check an edit before it is narrowed into an Edit
+static bool check_edit(const Keymap &keymap, zu32 layer, zu32 key){
+    return layer < keymap.numLayers() && key < keymap.numKeys();
+}
+
+bool Keymap::parseKeycode(ZString name, keycode &kc){
+    const std::string str = name.str();
+    zu32 num;
+    if(parse_uint(str, num) && num <= 0xFFFF){
+        kc = num;
+        return true;
     }
+    kc = toKeycode(name);
+    return (kc != KC_NO || str == "KC_NO");
 }
 
-ZString Keymap::keycodeName(keycode kc) const {
-    if(kcode_map.contains(kc)){
-        return kcode_map[kc].name;
+bool Keymap::parseEdits(ZString text, ZArray<Edit> &edits) const {
+    std::string str = text.str();
+    zu64 first = str.find_first_not_of(" \t\r\n");
+    if(first != std::string::npos && (str[first] == '[' || str[first] == '{')){
+        // JSON: [ { "layer": 0, "key": 1, "keycode": "KC_A" }, { "layer": 0, "row": 1, "col": 2, "keycode": "KC_B" } ]
+        nlohmann::json json;
+        try {
+            json = nlohmann::json::parse(str);
+        } catch(const std::exception &e){
+            ELOG("edit json parse error: " << e.what());
+            return false;
+        }
+        if(json.is_object() && json.count("edits"))
+            json = json["edits"];
+        if(!json.is_array()){
+            ELOG("edit json is not an array");
+            return false;
+        }
+
+        try {
+            for(zu64 i = 0; i < json.size(); ++i){
+                const nlohmann::json &jedit = json[i];
+                if(!jedit.is_object() || !jedit.count("layer") || !jedit.count("keycode")){
+                    ELOG("edit " << i << ": needs layer and keycode");
+                    return false;
+                }
+
+                zu32 layer, key, row, col;
+                if(!json_uint(jedit["layer"], layer)){
+                    ELOG("edit " << i << ": bad layer");
+                    return false;
+                }
+                if(jedit.count("key")){
+                    if(!json_uint(jedit["key"], key)){
+                        ELOG("edit " << i << ": bad key");
+                        return false;
+                    }
+                } else if(jedit.count("row") && jedit.count("col")){
+                    if(!json_uint(jedit["row"], row) || !json_uint(jedit["col"], col)){
+                        ELOG("edit " << i << ": bad row or col");
+                        return false;
+                    }
+                    key = edit_key(*this, row, col);
+                } else {
+                    ELOG("edit " << i << ": needs key or row and col");
+                    return false;
+                }
+                if(!check_edit(*this, layer, key)){
+                    ELOG("edit " << i << ": layer " << layer << ", key " << key << " out of range");
+                    return false;
+                }
+
+                Edit edit;
+                edit.layer = layer;
+                edit.key = key;
+                bool ok;
+                if(jedit["keycode"].is_number()){
+                    zu32 num;
+                    ok = json_uint(jedit["keycode"], num) && num <= 0xFFFF;
+                    edit.kc = ok ? num : 0;
+                } else {
+                    ok = jedit["keycode"].is_string() && parseKeycode(jedit["keycode"].get<std::string>(), edit.kc);
+                }
+                if(!ok){
+                    ELOG("edit " << i << ": unknown keycode");
+                    return false;
+                }
+                edits.push(edit);
+            }
+        } catch(const nlohmann::json::exception &e){
+            ELOG("edit json error: " << e.what());
+            return false;
+        }
+        return true;
+    }
+
+    // One edit per line, # starts a comment
+    std::istringstream stream(str);
+    std::string line;
+    for(zu64 ln = 1; std::getline(stream, line); ++ln){
+        line = line.substr(0, line.find('#'));
+        std::istringstream lstream(line);
+        ZArray<std::string> words;
+        std::string word;
+        while(lstream >> word)
+            words.push(word);
+        if(words.size() == 0)
+            continue;
+
+        zu32 layer, key, a, b;
+        if(words.size() == 3 && parse_uint(words[0], layer) && parse_uint(words[1], a)){
+            key = a;
+        } else if(words.size() == 4 && parse_uint(words[0], layer) && parse_uint(words[1], a) && parse_uint(words[2], b)){
+            key = edit_key(*this, a, b);
+        } else {
+            ELOG("line " << ln << ": expected <layer> [<row> <col> | <key>] <keycode>");
+            return false;
+        }
+        if(!check_edit(*this, layer, key)){
+            ELOG("line " << ln << ": layer " << layer << ", key " << key << " out of range");
+            return false;
+        }
+
+        Edit edit;
+        edit.layer = layer;
+        edit.key = key;
+
+        if(!parseKeycode(words[words.size() - 1], edit.kc)){
+            ELOG("line " << ln << ": unknown keycode " << words[words.size() - 1]);
+            return false;
+        }
+        edits.push(edit);
+    }
+    return true;
+}
+
+bool Keymap::applyEdits(const ZArray<Edit> &edits){
+    // validate everything first, so a bad edit leaves the keymap untouched
+    for(zsize i = 0; i < edits.size(); ++i){
+        if(edits[i].layer >= numLayers() || edits[i].key >= numKeys()){
+            ELOG("edit " << i << ": layer " << edits[i].layer << ", key " << edits[i].key << " out of range");
+            return false;
+        }
+    }
+    for(zsize i = 0; i < edits.size(); ++i){
+        set(edits[i].layer, edits[i].key, edits[i].kc);
+    }
+    return true;
+}
+
+Keymap::keycode Keymap::toKeycode(ZString name){
+    const KeycodeEntry *entry = findKeycodeName(name);
+    return entry ? entry->keycode : (keycode)KC_NO;
+}
+
+ZString Keymap::keycodeName(keycode kc){
+    const KeycodeEntry *entry = findKeycode(kc);
+    if(entry){
+        return entry->name;
     } else {
         return "0x" + ZString::ItoS(kc, 16, 4);
     }
 }
 
-ZString Keymap::keycodeAbbrev(keycode kc) const {
-    if(kcode_map.contains(kc)){
-        return kcode_map[kc].abbrev;
+ZString Keymap::keycodeAbbrev(keycode kc){
+    const KeycodeEntry *entry = findKeycode(kc);
+    if(entry){
+        return entry->abbrev;
     } else {
         return "0x" + ZString::ItoS(kc, 16, 4);
     }
 }
 
-ZString Keymap::keycodeDesc(keycode kc) const {
-    if(kcode_map.contains(kc)){
-        return kcode_map[kc].desc;
+ZString Keymap::keycodeDesc(keycode kc){
+    const KeycodeEntry *entry = findKeycode(kc);
+    if(entry){
+        return entry->desc;
     } else if(kc >= SAFE_RANGE){
         return "Custom keycode 0x" + ZString::ItoS(kc, 16, 4);
     } else {
@@ -689,20 +581,69 @@ ZString Keymap::keycodeDesc(keycode kc) const {
     }
 }
 
+bool Keymap::saveSnapshot(ZPath path) const {
+    return KeymapSnapshot::write(path, *this);
+}
+
+ZPointer<Keymap> Keymap::loadSnapshot(const KeymapSnapshot &snapshot){
+    const ZString name = snapshot.layoutName();
+    std::shared_ptr<const LayoutDirectory::Layout> hold;
+    const zu8 *lwidths;
+    const zu8 *lrows;
+    zu16 nrows;
+    if(!findLayoutKeys(name, hold, lwidths, lrows, nrows)){
+        ELOG("Unknown layout " << name);
+        return nullptr;
+    }
+
+    // the snapshot sizes are checked by KeymapSnapshot::load()
+    if(!checkLayoutMap(lwidths, lrows, nrows, snapshot.rows(), snapshot.cols(), snapshot.layoutMap())){
+        ELOG("Bad layout map for " << name);
+        return nullptr;
+    }
+
+    // layout and layers are read straight from the snapshot
+    ZPointer<Keymap> keymap = new Keymap(snapshot.rows(), snapshot.cols());
+    keymap->loadLayoutKeys(name, snapshot.layoutMap(), lwidths, lrows, nrows);
+    for(zu8 l = 0; l < snapshot.numLayers(); ++l){
+        keymap->loadLayerMatrix(snapshot.layerMatrix(l));
+    }
+    return keymap;
+}
+
+ZPointer<Keymap> Keymap::loadSnapshot(ZPath path){
+    KeymapSnapshot snapshot;
+    if(!snapshot.open(path))
+        return nullptr;
+    return loadSnapshot(snapshot);
+}
+
 const ZArray<Keymap::Keycode> &Keymap::getAllKeycodes(){
+    // only built if asked for
+    static ZArray<Keycode> keycodes;
+    if(!keycodes.size()){
+        for(zu64 i = 0; i < keycode_table_size; ++i){
+            const KeycodeEntry &entry = keycode_table[i];
+            keycodes.push({ entry.keycode, entry.name, entry.abbrev, entry.desc });
+        }
+    }
     return keycodes;
 }
 
 ZArray<ZString> Keymap::getKnownLayouts()
 {
-    ZArray<ZString> list;
-    zu64 n = keymaps_json_size / sizeof(unsigned);
-    for(zu64 i = 0; i < n; ++i){
-        zu64 len = keymaps_json_sizes[i];
-        ZString str(keymaps_json[i], len);
-        auto json = nlohmann::json::parse(str.str());
-//        LOG(i << " " << len << " " << json["name"].get<std::string>());
-        list.push(json["name"].get<std::string>());
+    ZArray<ZString> list = LayoutDirectory::global().names();
+    for(zu64 i = 0; i < layout_tables_size; ++i){
+        if(!list.contains(layout_tables[i].name))
+            list.push(layout_tables[i].name);
     }
     return list;
 }
+
+bool Keymap::isKnownLayout(ZString name){
+    return findLayout(name) || LayoutDirectory::global().find(name);
+}
+
+void Keymap::addLayoutPath(ZPath dir){
+    LayoutDirectory::global().addPath(dir);
+}
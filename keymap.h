@@ -4,8 +4,12 @@
 #include "zstring.h"
 #include "zbinary.h"
 #include "zmap.h"
+#include "zpath.h"
+#include "zpointer.h"
 using namespace LibChaos;
 
+class KeymapSnapshot;
+
 class Keymap {
 public:
     typedef zu16 keycode;
@@ -25,6 +29,13 @@ public:
         ZString desc;
     };
 
+    //! Change of one key on one layer.
+    struct Edit {
+        zu8 layer;
+        zu16 key;
+        keycode kc;
+    };
+
 public:
     Keymap(zu8 rows, zu8 cols);
 
@@ -33,15 +44,29 @@ public:
 
     ZArray<ZArray<keycode>> getKeycodeLayout(zu8 layer) const;
     //! Get layer matrices binary for firmware.
-    ZBinary toMatrix() const;
+    ZBinary toMatrix() const { return matrix; }
+    //! Copy layer matrices binary for firmware into \a out, reusing its buffer.
+    void toMatrix(ZBinary &out) const;
+    //! Layer matrices binary for firmware, kept up to date by set().
+    const ZBinary &matrixData() const { return matrix; }
 
     //! Pretty-print layout layers and keycodes.
     void printLayers() const;
     //! Print layer matrices and keycodes.
     void printMatrix() const;
 
-    keycode get(zu8 l, zu16 k) const { return layers[l][k]; }
-    void set(zu8 l, zu16 k, keycode kc){ layers[l][k] = kc; }
+    keycode get(zu8 l, zu16 k) const { return layer_keys[(l * nkeys) + k]; }
+    void set(zu8 l, zu16 k, keycode kc);
+    //! Get the sorted byte offsets in matrixData() of the cells changed by set() since clearDirty().
+    //! Returns false if clearDirty() was not called since the last loadLayerMap().
+    bool dirtyOffsets(ZArray<zu32> &offsets) const;
+    //! Mark matrixData() as in sync with the keyboard, and start tracking changed cells.
+    void clearDirty();
+    //! Unique for each clearDirty() call in the process, 0 before the first.
+    zu64 syncId() const { return sync_id; }
+
+    //! Keycodes of layer \a l, numKeys() long. Invalidated by loadLayerMap().
+    const keycode *layerKeys(zu8 l) const { return &layer_keys[l * nkeys]; }
 
     ZArray<int> getLayer(zu8 layer) const;
     ZArray<ZString> getLayerAbbrev(zu8 layer) const;
@@ -49,9 +74,17 @@ public:
     //! Get number of keys in layout.
     zu16 numKeys() const { return nkeys; }
     //! Get number of layers.
-    zsize numLayers() const { return layers.size(); }
-    //! Get number of rows in layout.
+    zsize numLayers() const { return nlayers; }
+    //! Get total key width of layout \a row.
     zu16 rowCount(zu8 row) const;
+    //! Get total key width of the widest layout row.
+    zu16 maxRowWidth() const { return mwidth; }
+    //! Get layout key \a k.
+    const Key &layoutKey(zu16 k) const { return wlayout[k]; }
+    zu8 matrixRows() const { return rows; }
+    zu8 matrixCols() const { return cols; }
+    //! Layout key number + 1 for each matrix position, 0 if none.
+    const ZArray<zu8> &layoutMap() const { return matrix2layout; }
 
     //! Get name of current layout.
     ZString layoutName() const { return layout_name; }
@@ -61,13 +94,37 @@ public:
 
     zu16 keyOffset(zu8 l, zu16 k) const;
 
-    keycode toKeycode(ZString name) const;
-    ZString keycodeName(keycode kc) const;
-    ZString keycodeAbbrev(keycode kc) const;
-    ZString keycodeDesc(keycode kc) const;
+    //! Parse a list of key edits, either as JSON or as lines of "<layer> [<row> <col> | <key>] <keycode>".
+    bool parseEdits(ZString text, ZArray<Edit> &edits) const;
+    //! Apply all \a edits, or none of them if any edit is out of range.
+    bool applyEdits(const ZArray<Edit> &edits);
+
+    //! Parse a keycode name, or a raw keycode number.
+    static bool parseKeycode(ZString name, keycode &kc);
+    static keycode toKeycode(ZString name);
+    static ZString keycodeName(keycode kc);
+    static ZString keycodeAbbrev(keycode kc);
+    static ZString keycodeDesc(keycode kc);
+
+    //! Save a binary snapshot of the keymap, see KeymapSnapshot.
+    bool saveSnapshot(ZPath path) const;
+    //! Load a keymap from a snapshot. Returns null if the layout is not known.
+    //! The keymap is an editable copy. Read-only users can read the KeymapSnapshot in place.
+    static ZPointer<Keymap> loadSnapshot(const KeymapSnapshot &snapshot);
+    static ZPointer<Keymap> loadSnapshot(ZPath path);
 
     static const ZArray<Keycode> &getAllKeycodes();
+    //! Get names of runtime and compiled-in layouts.
     static ZArray<ZString> getKnownLayouts();
+    static bool isKnownLayout(ZString name);
+    //! Search \a dir for layout JSON files, before the compiled-in layouts.
+    static void addLayoutPath(ZPath dir);
+
+private:
+    //! Load the layout map \a layout, rows * cols bytes, with the layout keys from findLayoutKeys().
+    void loadLayoutKeys(ZString name, const zbyte *layout, const zu8 *lwidths, const zu8 *lrows, zu16 nrows);
+    //! Add a layer from a little-endian matrix of rows * cols keycodes.
+    void loadLayerMatrix(const zbyte *layer);
 
 private:
     //! Matrix rows, columns.
@@ -76,9 +133,24 @@ private:
     ZMap<zu16, zu16> lkmap;
     ZArray<Key> wlayout;
     zu16 mwidth;
+    //! First key of each row, followed by nkeys.
+    ZArray<zu16> row_start;
+    //! Total key width of each row.
+    ZArray<zu16> row_width;
     ZArray<zu8> matrix2layout;
     ZArray<zu8> layout2matrix;
-    ZArray<ZArray<keycode>> layers;
+    //! Matrix index of each key, 0xFFFF if none.
+    ZArray<zu16> key_matrix;
+    //! Keycodes of all layers, nlayers * nkeys.
+    ZArray<keycode> layer_keys;
+    zu8 nlayers;
+    //! Little-endian layer matrices, nlayers * rows * cols.
+    ZBinary matrix;
+    //! Matrix cells changed since clearDirty(), and a flag byte for each cell.
+    ZArray<zu32> dirty;
+    ZBinary dirty_cells;
+    bool tracking;
+    zu64 sync_id;
 
     ZString layout_name;
 };
@@ -0,0 +1,266 @@
+#include "keymap_render.h"
+#include "keycodes.h"
+
+// SVG size of one layout width unit, and of a key row
+#define SVG_UNIT        12
+#define SVG_ROW         48
+#define SVG_TITLE       24
+#define SVG_DEFAULT_W   4
+
+KeymapRenderer::KeymapRenderer(Format format_) : format(format_){
+
+}
+
+void KeymapRenderer::render(const Keymap &keymap){
+    switch(format){
+    case TEXT:
+        for(zu8 l = 0; l < keymap.numLayers(); ++l){
+            buffer += "Layer ";
+            buffer += std::to_string(l);
+            if(isBlank(keymap, l)){
+                buffer += ": BLANK\n";
+            } else {
+                buffer += ":\n";
+                renderText(keymap, l);
+                buffer += '\n';
+            }
+        }
+        break;
+    case MATRIX:
+        for(zu8 l = 0; l < keymap.numLayers(); ++l){
+            buffer += "Layer ";
+            buffer += std::to_string(l);
+            buffer += ":\n";
+            renderMatrix(keymap, l);
+        }
+        break;
+    case JSON:
+        renderJSON(keymap);
+        break;
+    case SVG:
+        renderSVG(keymap);
+        break;
+    }
+}
+
+void KeymapRenderer::renderLayer(const Keymap &keymap, zu8 layer){
+    if(format == TEXT)
+        renderText(keymap, layer);
+    else if(format == MATRIX)
+        renderMatrix(keymap, layer);
+}
+
+bool KeymapRenderer::isBlank(const Keymap &keymap, zu8 layer){
+    const Keymap::keycode *keys = keymap.layerKeys(layer);
+    for(zsize i = 0; i < keymap.numKeys(); ++i){
+        if(keys[i] != KC_NO)
+            return false;
+    }
+    return true;
+}
+
+void KeymapRenderer::renderText(const Keymap &keymap, zu8 layer){
+    const zu16 nkeys = keymap.numKeys();
+    const zu16 mwidth = keymap.maxRowWidth();
+    const Keymap::keycode *keys = keymap.layerKeys(layer);
+
+    if(mwidth){
+        buffer.append((mwidth * 2) + 1, '=');
+        buffer += "\n|";
+    }
+    for(zsize i = 0; i < nkeys; ++i){
+        const Keymap::Key &key = keymap.layoutKey(i);
+        if(key.width){
+            buffer += keyLabel(keymap, keys[i], key.width);
+        } else {
+            buffer += keymap.keycodeName(keys[i]).str();
+            buffer += ", ";
+        }
+        if(key.newrow && mwidth){
+            buffer += '\n';
+            buffer.append((mwidth * 2) + 1, '=');
+            if(i < (nkeys - 1u))
+                buffer += "\n|";
+        }
+    }
+}
+
+void KeymapRenderer::renderMatrix(const Keymap &keymap, zu8 layer){
+    const zu8 rows = keymap.matrixRows();
+    const zu8 cols = keymap.matrixCols();
+    const zbyte *matrix = keymap.matrixData().raw() + (layer * rows * cols * sizeof(Keymap::keycode));
+
+    buffer += "{\n";
+    for(zsize r = 0; r < rows; ++r){
+        buffer += "  { ";
+        for(zsize c = 0; c < cols; ++c){
+            const Keymap::keycode kc = ZBinary::decleu16(matrix + (((r * cols) + c) * sizeof(Keymap::keycode)));
+            buffer += cellLabel(keymap, kc);
+        }
+        buffer += "},\n";
+    }
+    buffer += "}\n";
+}
+
+void KeymapRenderer::renderJSON(const Keymap &keymap){
+    const zu16 nkeys = keymap.numKeys();
+
+    buffer += "{\"layout\":\"";
+    appendEscaped(keymap.layoutName().str(), false);
+    buffer += "\",\"widths\":[[";
+    for(zsize i = 0; i < nkeys; ++i){
+        const Keymap::Key &key = keymap.layoutKey(i);
+        buffer += std::to_string(key.width);
+        if(i < (nkeys - 1u))
+            buffer += (key.newrow ? "],[" : ",");
+    }
+    buffer += "]],\"layers\":[";
+    for(zu8 l = 0; l < keymap.numLayers(); ++l){
+        const Keymap::keycode *keys = keymap.layerKeys(l);
+        buffer += (l ? ",[[" : "[[");
+        for(zsize i = 0; i < nkeys; ++i){
+            buffer += '"';
+            appendEscaped(keymap.keycodeName(keys[i]).str(), false);
+            buffer += '"';
+            if(i < (nkeys - 1u))
+                buffer += (keymap.layoutKey(i).newrow ? "],[" : ",");
+        }
+        buffer += "]]";
+    }
+    buffer += "]}\n";
+}
+
+void KeymapRenderer::renderSVG(const Keymap &keymap){
+    const zu16 nkeys = keymap.numKeys();
+
+    // size of one layer drawing
+    zu32 width = 0;
+    zu32 rwidth = 0;
+    zu32 nrows = 0;
+    for(zsize i = 0; i < nkeys; ++i){
+        const Keymap::Key &key = keymap.layoutKey(i);
+        rwidth += (key.width ? key.width : SVG_DEFAULT_W) * SVG_UNIT;
+        if(key.newrow || i == (nkeys - 1u)){
+            width = (rwidth > width ? rwidth : width);
+            rwidth = 0;
+            nrows++;
+        }
+    }
+    const zu32 lheight = SVG_TITLE + (nrows * SVG_ROW);
+    const zu32 height = lheight * keymap.numLayers();
+
+    buffer += "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"";
+    buffer += std::to_string(width);
+    buffer += "\" height=\"";
+    buffer += std::to_string(height);
+    buffer += "\" font-family=\"sans-serif\" font-size=\"10\">\n";
+
+    for(zu8 l = 0; l < keymap.numLayers(); ++l){
+        const Keymap::keycode *keys = keymap.layerKeys(l);
+        const zu32 ly = l * lheight;
+
+        buffer += "<g id=\"layer";
+        buffer += std::to_string(l);
+        buffer += "\">\n<text x=\"2\" y=\"";
+        buffer += std::to_string(ly + SVG_TITLE - 8);
+        buffer += "\" font-size=\"14\">";
+        appendEscaped(keymap.layoutName().str(), true);
+        buffer += " layer ";
+        buffer += std::to_string(l);
+        buffer += "</text>\n";
+
+        zu32 x = 0;
+        zu32 y = ly + SVG_TITLE;
+        for(zsize i = 0; i < nkeys; ++i){
+            const Keymap::Key &key = keymap.layoutKey(i);
+            const zu32 kw = (key.width ? key.width : SVG_DEFAULT_W) * SVG_UNIT;
+            if(!key.space){
+                const std::string sx = std::to_string(x + 1);
+                const std::string sy = std::to_string(y + 1);
+                buffer += "<rect x=\"" + sx + "\" y=\"" + sy + "\" width=\"";
+                buffer += std::to_string(kw - 2);
+                buffer += "\" height=\"";
+                buffer += std::to_string(SVG_ROW - 2);
+                buffer += "\" rx=\"4\" fill=\"";
+                buffer += (keys[i] == KC_NO ? "#eee" : "#ccc");
+                buffer += "\" stroke=\"#333\"/>\n<text x=\"";
+                buffer += std::to_string(x + (kw / 2));
+                buffer += "\" y=\"";
+                buffer += std::to_string(y + (SVG_ROW / 2) + 4);
+                buffer += "\" text-anchor=\"middle\"><title>";
+                appendEscaped(keymap.keycodeDesc(keys[i]).str(), true);
+                buffer += "</title>";
+                appendEscaped(keymap.keycodeAbbrev(keys[i]).str(), true);
+                buffer += "</text>\n";
+            }
+            x += kw;
+            if(key.newrow){
+                x = 0;
+                y += SVG_ROW;
+            }
+        }
+        buffer += "</g>\n";
+    }
+    buffer += "</svg>\n";
+}
+
+const std::string &KeymapRenderer::keyLabel(const Keymap &keymap, Keymap::keycode kc, zu8 width){
+    const zu32 id = ((zu32)kc << 8) | width;
+    auto it = key_labels.find(id);
+    if(it != key_labels.end())
+        return it->second;
+
+    // first half right-aligned, second half left-aligned, ending with the key border
+    const std::string str = keymap.keycodeAbbrev(kc).str();
+    const zu64 half = str.size() / 2;
+    std::string label;
+    if(half < (zu64)(width - 1))
+        label.append((width - 1) - half, ' ');
+    label.append(str, 0, half);
+    label.append(str, half, std::string::npos);
+    if(str.size() - half < (zu64)(width + 1))
+        label.append((width + 1) - (str.size() - half), ' ');
+    label[label.size() - 1] = '|';
+
+    return key_labels[id] = label;
+}
+
+const std::string &KeymapRenderer::cellLabel(const Keymap &keymap, Keymap::keycode kc){
+    auto it = cell_labels.find(kc);
+    if(it != cell_labels.end())
+        return it->second;
+
+    std::string label = keymap.keycodeName(kc).str() + ",";
+    if(label.size() < 20)
+        label.append(20 - label.size(), ' ');
+    label += ' ';
+
+    return cell_labels[kc] = label;
+}
+
+void KeymapRenderer::appendEscaped(const std::string &str, bool xml){
+    for(zu64 i = 0; i < str.size(); ++i){
+        const char ch = str[i];
+        if(xml){
+            switch(ch){
+            case '&': buffer += "&amp;"; break;
+            case '<': buffer += "&lt;"; break;
+            case '>': buffer += "&gt;"; break;
+            case '"': buffer += "&quot;"; break;
+            default: buffer += ch; break;
+            }
+        } else {
+            if(ch == '"' || ch == '\\'){
+                buffer += '\\';
+                buffer += ch;
+            } else if((unsigned char)ch < 0x20){
+                static const char hex[] = "0123456789abcdef";
+                buffer += "\\u00";
+                buffer += hex[(ch >> 4) & 0xF];
+                buffer += hex[ch & 0xF];
+            } else {
+                buffer += ch;
+            }
+        }
+    }
+}
@@ -0,0 +1,57 @@
+#ifndef KEYMAP_RENDER_H
+#define KEYMAP_RENDER_H
+
+#include "keymap.h"
+
+#include <string>
+#include <unordered_map>
+
+/*! Renders keymaps as text, JSON or SVG into a reusable buffer.
+ *  Padded key labels are cached, so one renderer can be reused for many
+ *  layers and keymaps without rebuilding them.
+ */
+class KeymapRenderer {
+public:
+    enum Format {
+        TEXT,   //!< Layout drawing, as printed by Keymap::printLayers().
+        MATRIX, //!< Keycode name matrices, as printed by Keymap::printMatrix().
+        JSON,   //!< One JSON object per keymap, with layout widths and keycode names.
+        SVG,    //!< One SVG document per keymap, with a drawing of each layer.
+    };
+
+public:
+    KeymapRenderer(Format format = TEXT);
+
+    //! Append all layers of \a keymap to the buffer.
+    void render(const Keymap &keymap);
+    //! Append one layer of \a keymap to the buffer, without a header. TEXT and MATRIX only.
+    void renderLayer(const Keymap &keymap, zu8 layer);
+
+    //! Rendered output.
+    const std::string &str() const { return buffer; }
+    //! Clear the output, keeping the buffer and label cache.
+    void clear(){ buffer.clear(); }
+
+    static bool isBlank(const Keymap &keymap, zu8 layer);
+
+private:
+    void renderText(const Keymap &keymap, zu8 layer);
+    void renderMatrix(const Keymap &keymap, zu8 layer);
+    void renderJSON(const Keymap &keymap);
+    void renderSVG(const Keymap &keymap);
+
+    //! Keycode abbreviation split and padded to fill a key of \a width.
+    const std::string &keyLabel(const Keymap &keymap, Keymap::keycode kc, zu8 width);
+    //! Keycode name followed by a comma, padded to a matrix cell.
+    const std::string &cellLabel(const Keymap &keymap, Keymap::keycode kc);
+
+    void appendEscaped(const std::string &str, bool xml);
+
+private:
+    const Format format;
+    std::string buffer;
+    std::unordered_map<zu32, std::string> key_labels;
+    std::unordered_map<zu32, std::string> cell_labels;
+};
+
+#endif // KEYMAP_RENDER_H
@@ -0,0 +1,85 @@
+#include "keymap_snapshot.h"
+
+#include "zfile.h"
+#include "zlog.h"
+
+#include <cstring>
+
+KeymapSnapshot::KeymapSnapshot() : base(nullptr), len(0){
+
+}
+
+bool KeymapSnapshot::open(ZPath path){
+    close();
+    if(!file.open(path))
+        return false;
+    if(!load(file.data(), file.size())){
+        file.close();
+        return false;
+    }
+    return true;
+}
+
+bool KeymapSnapshot::load(const zbyte *data, zu64 size){
+    base = nullptr;
+    len = 0;
+
+    if(size < SNAPSHOT_HEADER_LEN || memcmp(data, SNAPSHOT_MAGIC, 4) != 0){
+        ELOG("not a keymap snapshot");
+        return false;
+    }
+    if(ZBinary::decleu16(data + 4) != SNAPSHOT_VERSION){
+        ELOG("unsupported keymap snapshot version " << ZBinary::decleu16(data + 4));
+        return false;
+    }
+    const zu64 knum = data[6] * data[7];
+    if(!knum || !data[8]){
+        ELOG("empty keymap snapshot");
+        return false;
+    }
+    const zu64 expect = SNAPSHOT_HEADER_LEN + data[9] + knum + (data[8] * knum * sizeof(Keymap::keycode));
+    if(ZBinary::decleu32(data + 12) != expect || size < expect){
+        ELOG("bad keymap snapshot size");
+        return false;
+    }
+
+    base = data;
+    len = size;
+    return true;
+}
+
+void KeymapSnapshot::close(){
+    file.close();
+    base = nullptr;
+    len = 0;
+}
+
+ZString KeymapSnapshot::layoutName() const {
+    return ZString(base + SNAPSHOT_HEADER_LEN, base[9]);
+}
+
+bool KeymapSnapshot::write(ZPath path, const Keymap &keymap){
+    const std::string name = keymap.layoutName().str();
+    if(name.size() > 0xFF){
+        ELOG("layout name too long");
+        return false;
+    }
+    const ZBinary &matrix = keymap.matrixData();
+    const ZArray<zu8> &lmap = keymap.layoutMap();
+
+    ZBinary bin;
+    bin.write((const zbyte *)SNAPSHOT_MAGIC, 4);
+    bin.writeleu16(SNAPSHOT_VERSION);
+    bin.writeu8(keymap.matrixRows());
+    bin.writeu8(keymap.matrixCols());
+    bin.writeu8(keymap.numLayers());
+    bin.writeu8(name.size());
+    bin.writeleu16(0);
+    bin.writeleu32(SNAPSHOT_HEADER_LEN + name.size() + lmap.size() + matrix.size());
+    bin.write((const zbyte *)name.data(), name.size());
+    for(zsize i = 0; i < lmap.size(); ++i)
+        bin.writeu8(lmap[i]);
+    bin.write(matrix);
+
+    return ZFile::writeBinary(path, bin);
+}
@@ -0,0 +1,62 @@
+#ifndef KEYMAP_SNAPSHOT_H
+#define KEYMAP_SNAPSHOT_H
+
+#include "keymap.h"
+#include "mappedfile.h"
+
+#include "zpath.h"
+using namespace LibChaos;
+
+#define SNAPSHOT_MAGIC      "PKMS"
+#define SNAPSHOT_VERSION    1
+#define SNAPSHOT_HEADER_LEN 16
+
+/*! Binary keymap snapshot, read in place from a mapped file.
+ *
+ *  Format, all integers little-endian:
+ *  offset  size                    field
+ *  0       4                       magic "PKMS"
+ *  4       2                       format version
+ *  6       1                       matrix rows
+ *  7       1                       matrix cols
+ *  8       1                       number of layers
+ *  9       1                       layout name length
+ *  10      2                       reserved, zero
+ *  12      4                       total file size
+ *  16      name length             layout name
+ *  ...     rows * cols             layout map, layout key number + 1 for each matrix position, 0 if none
+ *  ...     layers * rows * cols * 2  layer matrices, one keycode for each matrix position
+ */
+class KeymapSnapshot {
+public:
+    KeymapSnapshot();
+    KeymapSnapshot(const KeymapSnapshot &) = delete;
+
+    //! Map the snapshot file at \a path and check its header.
+    bool open(ZPath path);
+    //! Use the snapshot in \a data, which must stay valid while in use.
+    bool load(const zbyte *data, zu64 size);
+    void close();
+
+    zu8 rows() const { return base[6]; }
+    zu8 cols() const { return base[7]; }
+    zu8 numLayers() const { return base[8]; }
+    ZString layoutName() const;
+
+    //! Layout map, rows * cols bytes.
+    const zbyte *layoutMap() const { return base + SNAPSHOT_HEADER_LEN + base[9]; }
+    //! Little-endian matrix of layer \a l, rows * cols keycodes.
+    const zbyte *layerMatrix(zu8 l) const { return layoutMap() + (rows() * cols()) + (l * rows() * cols() * sizeof(Keymap::keycode)); }
+    //! Keycode at matrix position \a mpos of layer \a l.
+    Keymap::keycode keycode(zu8 l, zu16 mpos) const { return ZBinary::decleu16(layerMatrix(l) + (mpos * sizeof(Keymap::keycode))); }
+
+    //! Write a snapshot of \a keymap to \a path.
+    static bool write(ZPath path, const Keymap &keymap);
+
+private:
+    MappedFile file;
+    const zbyte *base;
+    zu64 len;
+};
+
+#endif // KEYMAP_SNAPSHOT_H
@@ -0,0 +1,207 @@
+#include "keymap_stats.h"
+#include "keycodes.h"
+#include "fileutil.h"
+
+#include "zlog.h"
+#include "zthread.h"
+
+#include <thread>
+#include <atomic>
+#include <algorithm>
+
+#define MAX_LAYERS  256
+#define MAX_KEYS    256
+
+KeymapStats::KeymapStats() :
+    boards(0), failed(0),
+    layer_boards(MAX_LAYERS, 0), layer_keys(MAX_LAYERS, 0),
+    momentary(MAX_LAYERS, 0), layer_tap(MAX_LAYERS, 0),
+    searching(false), search(KC_NO)
+{
+
+}
+
+struct StatsWork {
+    const ZArray<ZPath> *files;
+    std::atomic<zu64> next;
+    std::vector<KeymapStats> partial;
+    //! Next entry in partial for a starting worker.
+    std::atomic<zu64> slot;
+};
+
+// Each worker takes the next file and counts into its own stats
+static void *stats_worker(ZThread::ZThreadArg zarg){
+    StatsWork *work = (StatsWork *)zarg.arg;
+    const ZArray<ZPath> &files = *work->files;
+    KeymapStats &stats = work->partial[work->slot++];
+    KeymapSnapshot snapshot;
+    for(zu64 i = work->next++; i < files.size(); i = work->next++){
+        if(snapshot.open(files[i])){
+            stats.add(snapshot, files[i].str());
+        } else {
+            stats.failed++;
+        }
+    }
+    return nullptr;
+}
+
+bool KeymapStats::scan(ZPath dir, unsigned threads){
+    ZArray<ZPath> files;
+    if(!listFiles(dir, files))
+        return false;
+
+    if(!threads)
+        threads = std::thread::hardware_concurrency();
+    if(!threads)
+        threads = 1;
+    if(threads > files.size())
+        threads = files.size() ? files.size() : 1;
+
+    StatsWork work;
+    work.files = &files;
+    work.next = 0;
+    work.slot = 0;
+    work.partial.resize(threads);
+    for(unsigned t = 0; t < threads; ++t){
+        work.partial[t].searching = searching;
+        work.partial[t].search = search;
+    }
+
+    // workers that did start still take every file
+    std::vector<ZThread> workers(threads);
+    unsigned started = 0;
+    while(started < threads && workers[started].run(stats_worker, &work))
+        started++;
+    for(unsigned t = 0; t < started; ++t)
+        workers[t].join();
+    if(!started){
+        ELOG("Failed to start workers");
+        return false;
+    }
+    for(unsigned t = 0; t < started; ++t)
+        merge(work.partial[t]);
+
+    // same order regardless of thread scheduling
+    std::sort(matches.begin(), matches.end(), [](const Match &a, const Match &b){
+        if(a.file != b.file)
+            return a.file.str() < b.file.str();
+        return a.layer != b.layer ? a.layer < b.layer : a.key < b.key;
+    });
+    return true;
+}
+
+void KeymapStats::add(const KeymapSnapshot &snapshot, const ZString &file){
+    const std::string layout = snapshot.layoutName().str();
+    const zu16 knum = snapshot.rows() * snapshot.cols();
+    const zbyte *lmap = snapshot.layoutMap();
+
+    boards++;
+    layouts[layout]++;
+    auto &counts = positions[layout];
+    if(counts.size() < snapshot.numLayers() * MAX_KEYS)
+        counts.resize(snapshot.numLayers() * MAX_KEYS);
+
+    for(zu8 l = 0; l < snapshot.numLayers(); ++l){
+        bool used = false;
+        for(zu16 mpos = 0; mpos < knum; ++mpos){
+            const zu8 lpos = lmap[mpos];
+            if(!lpos)
+                continue;
+            const Keymap::keycode kc = snapshot.keycode(l, mpos);
+            counts[(l * MAX_KEYS) + lpos - 1][kc]++;
+
+            if(kc != KC_NO && kc != KC_TRANSPARENT){
+                used = true;
+                layer_keys[l]++;
+                keycodes[kc]++;
+                if(kc >= QK_MOMENTARY && kc <= QK_MOMENTARY_MAX)
+                    momentary[kc & 0xFF]++;
+                else if(kc >= QK_LAYER_TAP && kc <= QK_LAYER_TAP_MAX)
+                    layer_tap[(kc >> 8) & 0xF]++;
+            }
+
+            if(searching && kc == search){
+                Match match;
+                match.file = file;
+                match.layer = l;
+                match.key = lpos - 1;
+                matches.push_back(match);
+            }
+        }
+        if(used)
+            layer_boards[l]++;
+    }
+}
+
+void KeymapStats::merge(const KeymapStats &other){
+    boards += other.boards;
+    failed += other.failed;
+    for(auto it = other.layouts.begin(); it != other.layouts.end(); ++it)
+        layouts[it->first] += it->second;
+    for(zu64 l = 0; l < MAX_LAYERS; ++l){
+        layer_boards[l] += other.layer_boards[l];
+        layer_keys[l] += other.layer_keys[l];
+        momentary[l] += other.momentary[l];
+        layer_tap[l] += other.layer_tap[l];
+    }
+    for(auto it = other.keycodes.begin(); it != other.keycodes.end(); ++it)
+        keycodes[it->first] += it->second;
+    for(auto it = other.positions.begin(); it != other.positions.end(); ++it){
+        auto &counts = positions[it->first];
+        if(counts.size() < it->second.size())
+            counts.resize(it->second.size());
+        for(zu64 p = 0; p < it->second.size(); ++p){
+            for(auto jt = it->second[p].begin(); jt != it->second[p].end(); ++jt)
+                counts[p][jt->first] += jt->second;
+        }
+    }
+    matches.insert(matches.end(), other.matches.begin(), other.matches.end());
+}
+
+// Sort keycode counts, most used first
+static std::vector<std::pair<Keymap::keycode, zu64>> sortCounts(const std::unordered_map<Keymap::keycode, zu64> &counts){
+    std::vector<std::pair<Keymap::keycode, zu64>> sorted(counts.begin(), counts.end());
+    std::sort(sorted.begin(), sorted.end(), [](const std::pair<Keymap::keycode, zu64> &a, const std::pair<Keymap::keycode, zu64> &b){
+        return a.second != b.second ? a.second > b.second : a.first < b.first;
+    });
+    return sorted;
+}
+
+void KeymapStats::print(zu32 top, bool show_positions) const {
+    LOG("Boards: " << boards << ", failed: " << failed);
+
+    LOG("Layouts:");
+    for(auto it = layouts.begin(); it != layouts.end(); ++it)
+        LOG("  " << ZString(it->first) << ": " << it->second);
+
+    LOG("Layers:");
+    for(zu64 l = 0; l < MAX_LAYERS; ++l){
+        if(!layer_boards[l] && !momentary[l] && !layer_tap[l])
+            continue;
+        LOG("  " << l << ": " << layer_boards[l] << " boards, " << layer_keys[l] << " keys, " <<
+            momentary[l] << " MO, " << layer_tap[l] << " LT");
+    }
+
+    LOG("Keycodes:");
+    auto sorted = sortCounts(keycodes);
+    for(zu64 i = 0; i < sorted.size() && i < top; ++i)
+        LOG("  " << Keymap::keycodeName(sorted[i].first) << ": " << sorted[i].second);
+
+    // most common keycode at each position
+    for(auto it = positions.begin(); show_positions && it != positions.end(); ++it){
+        LOG("Positions " << ZString(it->first) << ":");
+        for(zu64 p = 0; p < it->second.size(); ++p){
+            if(it->second[p].empty())
+                continue;
+            auto pos = sortCounts(it->second[p]);
+            LOG("  layer " << (p / MAX_KEYS) << ", key " << (p % MAX_KEYS) << ": " <<
+                 Keymap::keycodeName(pos[0].first) << " (" << pos[0].second << "/" << layouts.at(it->first) << ")");
+        }
+    }
+
+    if(searching){
+        LOG("Matches for " << Keymap::keycodeName(search) << ": " << matches.size());
+        for(zu64 i = 0; i < matches.size(); ++i)
+            LOG("  " << matches[i].file << ": layer " << matches[i].layer << ", key " << matches[i].key);
+    }
+}
@@ -0,0 +1,72 @@
+#ifndef KEYMAP_STATS_H
+#define KEYMAP_STATS_H
+
+#include "keymap.h"
+#include "keymap_snapshot.h"
+
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+
+#include "zpath.h"
+using namespace LibChaos;
+
+/*! Aggregate statistics over a directory of keymap snapshots.
+ *  Snapshots are read in place by a pool of worker threads, each with its own
+ *  KeymapStats, which are merged when all files have been scanned.
+ */
+class KeymapStats {
+public:
+    //! A key bound to the searched keycode.
+    struct Match {
+        ZString file;
+        zu8 layer;
+        zu16 key;
+    };
+
+public:
+    KeymapStats();
+
+    //! Also collect every key bound to \a kc.
+    void setSearch(Keymap::keycode kc){ search = kc; searching = true; }
+
+    //! Scan all snapshot files in \a dir, using \a threads workers (0 for one per core).
+    //! Files that are not snapshots are counted as failed.
+    bool scan(ZPath dir, unsigned threads = 0);
+
+    //! Add one snapshot.
+    void add(const KeymapSnapshot &snapshot, const ZString &file);
+    //! Add the counts from \a other.
+    void merge(const KeymapStats &other);
+
+    //! Log a summary, with up to \a top entries in each list.
+    //! With \a positions, also log the most common keycode at each key position.
+    void print(zu32 top = 20, bool positions = false) const;
+
+public:
+    zu64 boards;
+    zu64 failed;
+    //! Boards using each layout.
+    std::map<std::string, zu64> layouts;
+    //! Boards with any key set on each layer.
+    std::vector<zu64> layer_boards;
+    //! Keys set on each layer, not KC_NO or KC_TRNS.
+    std::vector<zu64> layer_keys;
+    //! MO(layer) keys, by target layer.
+    std::vector<zu64> momentary;
+    //! LT(layer, kc) keys, by target layer.
+    std::vector<zu64> layer_tap;
+    //! Count of each keycode.
+    std::unordered_map<Keymap::keycode, zu64> keycodes;
+    //! Count of each keycode at each key position, by layout name, indexed by (layer * 256) + layout key number.
+    std::map<std::string, std::vector<std::unordered_map<Keymap::keycode, zu64>>> positions;
+    //! Keys bound to the searched keycode.
+    std::vector<Match> matches;
+
+private:
+    bool searching;
+    Keymap::keycode search;
+};
+
+#endif // KEYMAP_STATS_H
@@ -0,0 +1,213 @@
+#include "layoutdir.h"
+#include "fileutil.h"
+
+#include "zlog.h"
+
+#include <nlohmann/json.hpp>
+
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+#include <sys/stat.h>
+
+#define INDEX_HEADER    "pok3rtool-layout-index 2"
+
+#if LIBCHAOS_PLATFORM == LIBCHAOS_PLATFORM_WINDOWS
+    #define PATH_LIST_SEP ';'
+#else
+    #define PATH_LIST_SEP ':'
+#endif
+
+// Get modification time in nanoseconds and size, mtime -1 if the file does not exist
+static zs64 file_mtime(const std::string &path, zs64 *size = nullptr){
+    struct stat st;
+    if(stat(path.c_str(), &st) != 0)
+        return -1;
+    if(size)
+        *size = st.st_size;
+#if LIBCHAOS_PLATFORM == LIBCHAOS_PLATFORM_WINDOWS
+    return (zs64)st.st_mtime * 1000000000;
+#elif LIBCHAOS_PLATFORM == LIBCHAOS_PLATFORM_MACOSX
+    return (zs64)st.st_mtimespec.tv_sec * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+    return (zs64)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+}
+
+LayoutDirectory &LayoutDirectory::global(){
+    static LayoutDirectory dir;
+    return dir;
+}
+
+LayoutDirectory::LayoutDirectory(){
+    const char *env = getenv(LAYOUT_PATH_ENV);
+    if(env){
+        std::istringstream paths(env);
+        std::string path;
+        while(std::getline(paths, path, PATH_LIST_SEP)){
+            if(!path.empty())
+                addPath(ZString(path));
+        }
+    }
+}
+
+void LayoutDirectory::addPath(ZPath dir){
+    std::lock_guard<std::mutex> lock(mutex);
+    Directory d;
+    d.path = dir.str().str();
+    d.mtime = -1;
+    d.rebuild = false;
+    dirs.push_back(d);
+}
+
+std::shared_ptr<const LayoutDirectory::Layout> LayoutDirectory::find(const ZString &name){
+    std::lock_guard<std::mutex> lock(mutex);
+    const std::string str = name.str();
+    for(auto &dir : dirs){
+        refresh(dir);
+        auto it = dir.entries.find(str);
+        if(it == dir.entries.end())
+            continue;
+
+        Entry &entry = it->second;
+        const std::string path = dir.path + "/" + entry.file;
+        zs64 size = 0;
+        const zs64 mtime = file_mtime(path, &size);
+        if(!entry.layout || mtime != entry.mtime || size != entry.size){
+            // parse on first use, or again after the file changed
+            std::shared_ptr<Layout> layout = std::make_shared<Layout>();
+            if(!parseLayout(path, *layout) || layout->name != str){
+                // file changed to a different layout, reindex next time
+                dir.mtime = -1;
+                dir.rebuild = true;
+                continue;
+            }
+            entry.layout = layout;
+            entry.mtime = mtime;
+            entry.size = size;
+        }
+        return entry.layout;
+    }
+    return nullptr;
+}
+
+ZArray<ZString> LayoutDirectory::names(){
+    std::lock_guard<std::mutex> lock(mutex);
+    ZArray<ZString> list;
+    for(auto &dir : dirs){
+        refresh(dir);
+        for(auto it = dir.entries.begin(); it != dir.entries.end(); ++it)
+            list.push(it->first);
+    }
+    return list;
+}
+
+bool LayoutDirectory::parseLayout(const std::string &file, Layout &layout){
+    std::ifstream in(file);
+    if(!in)
+        return false;
+    std::stringstream text;
+    text << in.rdbuf();
+
+    try {
+        auto json = nlohmann::json::parse(text.str());
+        layout.name = json["name"].get<std::string>();
+        layout.keys.clear();
+        layout.rows.clear();
+        for(auto &jrow : json["layout"]){
+            if(jrow.empty() || jrow.size() > 0xFF)
+                throw std::runtime_error("bad layout row");
+            for(auto &jkey : jrow){
+                const int width = jkey.get<int>();
+                if(width < 0 || width > 0xFF)
+                    throw std::runtime_error("bad key width");
+                layout.keys.push_back(width);
+            }
+            layout.rows.push_back(jrow.size());
+        }
+    } catch(const std::exception &e){
+        ELOG("layout " << ZString(file) << ": " << e.what());
+        return false;
+    }
+    return layout.rows.size() > 0;
+}
+
+void LayoutDirectory::refresh(Directory &dir){
+    const zs64 mtime = file_mtime(dir.path);
+    if(mtime == dir.mtime)
+        return;
+    dir.mtime = mtime;
+    if(mtime < 0){
+        dir.entries.clear();
+        return;
+    }
+    if(!dir.rebuild && readIndex(dir))
+        return;
+    dir.rebuild = false;
+
+    // rebuild index from the layout names in each file
+    DLOG("Indexing layouts in " << ZString(dir.path));
+    dir.entries.clear();
+    ZArray<ZPath> files;
+    listFiles(ZString(dir.path), files, ".json");
+    for(zsize i = 0; i < files.size(); ++i){
+        std::shared_ptr<Layout> layout = std::make_shared<Layout>();
+        const std::string path = files[i].str().str();
+        if(!parseLayout(path, *layout))
+            continue;
+        if(dir.entries.count(layout->name)){
+            ELOG("duplicate layout " << ZString(layout->name) << " in " << ZString(dir.path));
+            continue;
+        }
+        Entry entry;
+        entry.file = files[i].last().str();
+        entry.mtime = file_mtime(path, &entry.size);
+        entry.layout = layout;
+        dir.entries[layout->name] = entry;
+    }
+    writeIndex(dir);
+    // creating the index changes the directory
+    dir.mtime = file_mtime(dir.path);
+}
+
+bool LayoutDirectory::readIndex(Directory &dir){
+    // stale if files were added or removed after the index was written,
+    // or in the same clock tick
+    const std::string path = dir.path + "/" LAYOUT_INDEX_FILE;
+    if(file_mtime(path) <= dir.mtime)
+        return false;
+    std::ifstream in(path);
+    if(!in)
+        return false;
+    std::string line;
+    if(!std::getline(in, line) || line != INDEX_HEADER)
+        return false;
+
+    // name, file, file mtime, file size
+    dir.entries.clear();
+    while(std::getline(in, line)){
+        std::istringstream fields(line);
+        std::string name, mtime, size;
+        Entry entry;
+        if(!std::getline(fields, name, '\t') || !std::getline(fields, entry.file, '\t') ||
+                !std::getline(fields, mtime, '\t') || !std::getline(fields, size)){
+            dir.entries.clear();
+            return false;
+        }
+        entry.mtime = std::strtoll(mtime.c_str(), nullptr, 10);
+        entry.size = std::strtoll(size.c_str(), nullptr, 10);
+        dir.entries[name] = entry;
+    }
+    return true;
+}
+
+void LayoutDirectory::writeIndex(const Directory &dir){
+    const std::string path = dir.path + "/" LAYOUT_INDEX_FILE;
+    std::ofstream out(path);
+    out << INDEX_HEADER << "\n";
+    for(auto it = dir.entries.begin(); it != dir.entries.end(); ++it)
+        out << it->first << "\t" << it->second.file << "\t" << it->second.mtime << "\t" << it->second.size << "\n";
+    out.close();
+    if(!out)
+        DLOG("Unable to write layout index " << ZString(path));
+}
@@ -0,0 +1,76 @@
+#ifndef LAYOUTDIR_H
+#define LAYOUTDIR_H
+
+#include "zstring.h"
+#include "zpath.h"
+#include "zarray.h"
+using namespace LibChaos;
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+
+#define LAYOUT_INDEX_FILE   ".layout_index"
+#define LAYOUT_PATH_ENV     "POK3RTOOL_LAYOUT_PATH"
+
+/*! Layout JSON files found at runtime, in the same format as the keymaps/ JSON files.
+ *  Each directory on the search path gets an index file mapping layout names to
+ *  files, built on first use and rebuilt when the directory was modified after
+ *  the index was written. Files are parsed when first looked up, and parsed again if their
+ *  modification time (to the nanosecond where the platform has it) or size changes.
+ *  The search path is initialized from the POK3RTOOL_LAYOUT_PATH environment variable.
+ */
+class LayoutDirectory {
+public:
+    struct Layout {
+        std::string name;
+        //! Layout key widths, including spacers.
+        std::vector<zu8> keys;
+        //! Number of keys in each row.
+        std::vector<zu8> rows;
+    };
+
+public:
+    //! Get the process-wide layout directory.
+    static LayoutDirectory &global();
+
+    //! Add \a dir to the end of the search path.
+    void addPath(ZPath dir);
+    //! Find a layout by name, null if not found. Earlier directories take precedence.
+    std::shared_ptr<const Layout> find(const ZString &name);
+    //! Get the names of all layouts on the search path.
+    ZArray<ZString> names();
+
+    //! Parse a layout JSON file.
+    static bool parseLayout(const std::string &file, Layout &layout);
+
+private:
+    LayoutDirectory();
+
+    struct Entry {
+        std::string file;
+        zs64 mtime;
+        zs64 size;
+        std::shared_ptr<const Layout> layout;
+    };
+    struct Directory {
+        std::string path;
+        zs64 mtime;
+        //! Ignore the index file on the next refresh.
+        bool rebuild;
+        std::unordered_map<std::string, Entry> entries;
+    };
+
+    //! Load or rebuild the index of \a dir if the directory changed.
+    void refresh(Directory &dir);
+    bool readIndex(Directory &dir);
+    void writeIndex(const Directory &dir);
+
+private:
+    std::mutex mutex;
+    std::vector<Directory> dirs;
+};
+
+#endif // LAYOUTDIR_H
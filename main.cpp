@@ -2,7 +2,14 @@
 #include "proto_pok3r.h"
 #include "proto_cykb.h"
 #include "keymap.h"
+#include "keymap_render.h"
+#include "keymap_stats.h"
 #include "updatepackage.h"
+#include "decodecache.h"
+#include "packagescan.h"
+#include "mappedfile.h"
+#include "fileutil.h"
+#include "backlight.h"
 
 #include "zlog.h"
 #include "zfile.h"
@@ -19,6 +26,7 @@ using namespace LibChaos;
 
 struct Param {
     bool ok;
+    bool all;
     ZArray<ZString> args;
     DeviceType device;
 };
@@ -216,6 +224,24 @@ int cmd_dump(Param *param){
     // Dump Flash
     ZPointer<KBProto> kb = openDevice(param->device);
     if(kb.get()){
+        if(kb->isQMK()){
+            // read flash from running firmware, no reboot needed
+            LOG("Dump Flash (QMK)");
+            ProtoQMK *qmk = dynamic_cast<ProtoQMK *>(kb.get());
+            ZFile file;
+            if(!file.open(out, ZFile::WRITE)){
+                ELOG("Failed to open file");
+                return -3;
+            }
+            zu64 total = 0;
+            bool ret = qmk->dumpFlashQMK([&](const ZBinary &chunk){
+                total += chunk.size();
+                return file.write(chunk) == chunk.size();
+            });
+            LOG("Out: " << out << ", " << total << " bytes");
+            return ret ? 0 : -4;
+        }
+
         LOG("Dump Flash");
         ZBinary bin = kb->dumpFlash();
 //        RLOG(bin.dumpBytes(4, 8));
@@ -277,10 +303,18 @@ int cmd_wipe(Param *param){
 
 int cmd_decode(Param *param){
     UpdatePackage package;
+    LOG("Extract from " << param->args[1]);
     if(!package.loadFromExe(param->args[1], 0)){
         ELOG("Load Error: " << param->args[1]);
         return 1;
     }
+    package.printInfo();
+    if(param->all){
+        if(!package.writeAll(param->args[2]))
+            return 2;
+        LOG("Done");
+        return 0;
+    }
     ZPath out = param->args[2];
     LOG("Write " << out);
     ZBinary fw = package.getFirmware();
@@ -292,6 +326,129 @@ int cmd_decode(Param *param){
     return 0;
 }
 
+int cmd_identify(Param *param){
+    ZPath path = param->args[1];
+    ZArray<ZPath> files;
+    if(ZFile::isDir(path)){
+        if(!listFiles(path, files, ".exe")){
+            ELOG("Unable to list " << path);
+            return 1;
+        }
+    } else {
+        files.push(path);
+    }
+
+    // --all hashes every file in full, and prints the fingerprints of known updaters
+    zu64 known = 0;
+    ZArray<ZString> table;
+    for(zu64 i = 0; i < files.size(); ++i){
+        zu64 hash;
+        PackType type;
+        if(param->all){
+            PackageFingerprint fp;
+            type = UpdatePackage::fingerprint(files[i], fp);
+            hash = fp.hash;
+            if(type != PACKAGE_NONE){
+                table.push("    { 0x" + ZString::ItoS(fp.size, 16) + ", 0x" + ZString::ItoS(fp.trailer, 16, 16) +
+                           ", 0x" + ZString::ItoS(fp.sample, 16, 16) + ", 0x" + ZString::ItoS(fp.hash, 16, 16) +
+                           " }, // " + files[i].last());
+            }
+        } else {
+            type = UpdatePackage::identify(files[i], hash);
+        }
+        if(type != PACKAGE_NONE)
+            known++;
+        LOG(files[i].last() << "\t" << (hash ? ZString::ItoS(hash, 16) : ZString("-")) << "\t" << PackageInfo::typeName(type));
+    }
+    LOG(known << "/" << files.size() << " supported updaters");
+    for(zu64 i = 0; i < table.size(); ++i)
+        LOG(table[i]);
+    return 0;
+}
+
+int cmd_repack(Param *param){
+    ZPath exe = param->args[1];
+    ZPath firmware = param->args[2];
+    ZPath out = param->args[3];
+    zu64 index = PackageInfo::NO_OUTPUT;
+    if(param->args.size() > 4){
+        if(!param->args[4].isInteger()){
+            ELOG("Bad index");
+            return 2;
+        }
+        index = param->args[4].toUint();
+    }
+
+    // the output is decoded and checked before it replaces anything
+    LOG("Repack " << exe);
+    if(!UpdatePackage::repack(exe, firmware, out, index)){
+        ELOG("Repack Error: " << exe);
+        return 1;
+    }
+    LOG("Write " << out);
+    LOG("Done");
+    return 0;
+}
+
+int cmd_scan(Param *param){
+    ZPath exe = param->args[1];
+    MappedFile file;
+    if(!file.open(exe)){
+        ELOG("Failed to open " << exe);
+        return 1;
+    }
+
+    const PackageFormat *fmt = PackageScanner::probe(file.data(), file.size());
+    LOG("Format: " << (fmt ? fmt->name : "unknown"));
+
+    static const char *kinds[] = { "signature", "manifest", "vectors" };
+    static const char *ciphers[] = { "none", "package", "kbp" };
+    static const char *firmwares[] = { "plain", "pok3r", "cykb" };
+
+    std::vector<ScanHit> hits;
+    PackageScanner::scan(file.data(), file.size(), hits);
+    for(auto it = hits.begin(); it != hits.end(); ++it){
+        ZString line = ZString(kinds[it->kind]) + "\t0x" + ZString::ItoS(it->offset, 16) +
+                "\t" + ciphers[it->cipher] + "\t" + firmwares[it->firmware] +
+                "\t" + (it->format ? it->format->name : "-");
+        if(it->kind == ScanHit::VECTOR_TABLE){
+            line += "\tsp 0x" + ZString::ItoS(it->value1, 16) + " reset 0x" + ZString::ItoS(it->value2, 16);
+        } else if(it->kind == ScanHit::MANIFEST){
+            line += "\tfirmware " + ZString::ItoS(it->value1);
+        }
+        LOG(line);
+    }
+    LOG(hits.size() << " hits");
+    return 0;
+}
+
+int cmd_decode_all(Param *param){
+    ZPath dir = param->args[1];
+    ZPath outdir = param->args[2];
+    if(!UpdatePackage::decodeDirectory(dir, outdir)){
+        ELOG("Decode Error: " << dir);
+        return 1;
+    }
+    return 0;
+}
+
+int cmd_bench(Param *param){
+    // default is about the size of a MAAV105 updater
+    zu64 size = 0x200000;
+    if(param->args.size() > 1){
+        if(!param->args[1].isInteger()){
+            ELOG("Bad size");
+            return 2;
+        }
+        size = param->args[1].toUint();
+    }
+    if(!UpdatePackage::benchmark(size, 20)){
+        ELOG("Benchmark failed");
+        return 1;
+    }
+    return 0;
+}
+
 int cmd_eeprom(Param *param){
     ZPointer<KBProto> kb = openDevice(param->device);
     if(kb.get()){
@@ -323,10 +480,7 @@ int cmd_eeprom(Param *param){
 
         } else if(param->args[1] == "wipe"){
             LOG("Wipe EEPROM");
-            for(zu32 i = 0; i < 128; ++i){
-                LOG(qmk->eraseEEPROM(i << 12));
-                ZThread::msleep(500);
-            }
+            LOG(qmk->wipeEEPROM());
 
         } else if(param->args[1] == "keymap"){
             if(param->args.size() != 2){
@@ -408,6 +562,47 @@ int cmd_keymap(Param *param){
             //keymap->printLayers();
             LOG(qmk->uploadKeymap(keymap));
 
+        } else if(param->args[1] == "apply"){
+            if(param->args.size() != 3 && !(param->args.size() == 4 && param->args[3] == "commit")){
+                ELOG("Usage: pok3rtool keymap apply <edit file> [commit]");
+                return -2;
+            }
+
+            ZBinary text;
+            if(!ZFile::readBinary(ZPath(param->args[2]), text)){
+                ELOG("Failed to read file");
+                return -3;
+            }
+            text.nullTerm();
+
+            auto keymap = qmk->loadKeymap();
+            if(!keymap.get()){
+                ELOG("Unable to load keymap");
+                return -3;
+            }
+
+            ZArray<Keymap::Edit> edits;
+            if(!keymap->parseEdits(ZString(text.asChar()), edits)){
+                ELOG("Invalid edit file");
+                return -4;
+            }
+
+            LOG("Keymap Apply: " << edits.size() << " edits");
+            for(zsize i = 0; i < edits.size(); ++i){
+                DLOG("layer " << edits[i].layer << ", key " << edits[i].key << " -> " << keymap->keycodeName(edits[i].kc));
+            }
+            if(!keymap->applyEdits(edits))
+                return -4;
+            if(!qmk->uploadKeymap(keymap)){
+                ELOG("Keymap upload failed");
+                return -5;
+            }
+
+            if(param->args.size() == 4){
+                LOG("Commit Keymap");
+                LOG(qmk->commitKeymap());
+            }
+
         } else if(param->args[1] == "commit"){
             if(param->args.size() != 2){
                 ELOG("Usage: pok3rtool keymap commit");
@@ -458,6 +653,60 @@ int cmd_keymap(Param *param){
             LOG("No Such Layout " << layout);
             return -3;
 
+        } else if(param->args[1] == "save"){
+            if(param->args.size() != 3){
+                ELOG("Usage: pok3rtool keymap save <snapshot file>");
+                return -2;
+            }
+
+            auto keymap = qmk->loadKeymap();
+            if(!keymap.get()){
+                ELOG("Unable to load keymap");
+                return -3;
+            }
+
+            ZPath out = param->args[2];
+            if(!keymap->saveSnapshot(out)){
+                ELOG("Failed to write file");
+                return -4;
+            }
+            LOG("Out: " << out);
+
+        } else if(param->args[1] == "export"){
+            if(param->args.size() != 4){
+                ELOG("Usage: pok3rtool keymap export <text|matrix|json|svg> <file>");
+                return -2;
+            }
+
+            KeymapRenderer::Format format;
+            if(param->args[2] == "text"){
+                format = KeymapRenderer::TEXT;
+            } else if(param->args[2] == "matrix"){
+                format = KeymapRenderer::MATRIX;
+            } else if(param->args[2] == "json"){
+                format = KeymapRenderer::JSON;
+            } else if(param->args[2] == "svg"){
+                format = KeymapRenderer::SVG;
+            } else {
+                ELOG("Unknown format " << param->args[2]);
+                return -2;
+            }
+
+            auto keymap = qmk->loadKeymap();
+            if(!keymap.get()){
+                ELOG("Unable to load keymap");
+                return -3;
+            }
+
+            KeymapRenderer renderer(format);
+            renderer.render(*keymap);
+            ZPath out = param->args[3];
+            if(!ZFile::writeBinary(out, ZBinary(renderer.str().data(), renderer.str().size()))){
+                ELOG("Failed to write file");
+                return -4;
+            }
+            LOG("Out: " << out << ", " << renderer.str().size() << " bytes");
+
         } else {
             LOG("Usage: pok3rtool keymap");
         }
@@ -466,6 +715,102 @@ int cmd_keymap(Param *param){
     return -1;
 }
 
+int cmd_backlight(Param *param){
+    ZPointer<KBProto> kb = openDevice(param->device);
+    if(kb.get()){
+        if(!kb->isQMK()){
+            ELOG("Not a QMK keyboard!");
+            return -2;
+        }
+        ProtoQMK *qmk = dynamic_cast<ProtoQMK *>(kb.get());
+
+        if(param->args[1] == "info"){
+            ZBinary info;
+            if(!qmk->getBacklightInfo(info)){
+                ELOG("Unable to read backlight info");
+                return -3;
+            }
+            LOG("Backlight: " << info[0] << " layers, " << info[1] << "/" << info[2] << " r/c, " << info[3] << " bytes per key");
+
+        } else if(param->args[1] == "commit"){
+            LOG("Commit Backlight");
+            LOG(qmk->commitBacklight());
+
+        } else if(param->args[1] == "demo"){
+            zu32 fps = 30;
+            if(param->args.size() == 3)
+                fps = param->args[2].toUint();
+            if(fps == 0 || fps > 500){
+                ELOG("Bad frame rate");
+                return -2;
+            }
+
+            BacklightStream stream(qmk, fps);
+            if(!stream.start()){
+                ELOG("Unable to start backlight stream");
+                return -3;
+            }
+            const ZBinary orig = stream.frame();
+
+            // sweep one lit key across the matrix, submitting faster than the frame rate
+            LOG("Backlight Demo: " << fps << " fps");
+            const zu32 keys = stream.numRows() * stream.numCols();
+            for(zu32 i = 0; i < keys * 4; ++i){
+                ZBinary frame;
+                frame.fill(0, stream.frameSize());
+                for(zu8 j = 0; j < stream.entrySize(); ++j)
+                    frame[((i % keys) * stream.entrySize()) + j] = 0xFF;
+                stream.submit(frame);
+                ZThread::msleep(500 / fps);
+            }
+            stream.submit(orig);
+            stream.stop();
+
+            auto st = stream.stats();
+            LOG("Sent " << st.sent << " frames, dropped " << st.dropped << ", errors " << st.errors);
+            LOG("Rate " << st.fps << " fps, latency " << st.latency_ms << " ms");
+
+        } else {
+            LOG("Usage: pok3rtool backlight <info|commit|demo> [fps]");
+        }
+        return 0;
+    }
+    return -1;
+}
+
+int cmd_snapshot(Param *param){
+    auto keymap = Keymap::loadSnapshot(ZPath(param->args[1]));
+    if(!keymap.get()){
+        ELOG("Unable to load keymap snapshot");
+        return -2;
+    }
+
+    LOG("Keymap Snapshot: " << keymap->numKeys() << " keys, " << keymap->numLayers() << " layers");
+    LOG("Layout: " << keymap->layoutName());
+    keymap->printLayers();
+    return 0;
+}
+
+int cmd_stats(Param *param){
+    KeymapStats stats;
+    if(param->args.size() == 3){
+        Keymap::keycode kc;
+        if(!Keymap::parseKeycode(param->args[2], kc)){
+            ELOG("Unknown keycode " << param->args[2]);
+            return -2;
+        }
+        stats.setSearch(kc);
+    }
+
+    ZPath dir = param->args[1];
+    if(!stats.scan(dir)){
+        ELOG("Unable to scan " << dir);
+        return -3;
+    }
+    stats.print(20, param->all);
+    return 0;
+}
+
 int cmd_console(Param *param){
     while(true){
         ZPointer<HIDDevice> con = KBScan::openConsole(param->device);
@@ -493,11 +838,19 @@ int cmd_console(Param *param){
 #define OPT_OK      "ok"
 #define OPT_VERBOSE "verbose"
 #define OPT_TYPE    "device"
+#define OPT_LAYOUTS "layouts"
+#define OPT_CACHE   "cache"
+#define OPT_NOCACHE "no-cache"
+#define OPT_ALL     "all"
 
 const ZArray<ZOptions::OptDef> optdef = {
     { OPT_OK,       0,   ZOptions::NONE },
     { OPT_VERBOSE,  'v', ZOptions::NONE},
     { OPT_TYPE,     't', ZOptions::STRING },
+    { OPT_LAYOUTS,  'l', ZOptions::STRING },
+    { OPT_CACHE,    0,   ZOptions::STRING },
+    { OPT_NOCACHE,  0,   ZOptions::NONE },
+    { OPT_ALL,      'a', ZOptions::NONE },
 };
 
 typedef int (*cmd_func)(Param *);
@@ -518,9 +871,17 @@ const ZMap<ZString, CmdEntry> cmds = {
     { "dump",       { cmd_dump,         1, 1, "dump <flash dump>" } },
     { "flash",      { cmd_flash,        2, 2, "flash <version> <firmware>" } },
     { "wipe",       { cmd_wipe,        	0, 0, "wipe" } },
-    { "decode",     { cmd_decode,       2, 2, "decode <path to updater> <output file>" } },
+    { "decode",     { cmd_decode,       2, 2, "decode [--all] <path to updater> <output file>" } },
+    { "identify",   { cmd_identify,     1, 1, "identify [--all] <updater or dir>" } },
+    { "repack",     { cmd_repack,       3, 4, "repack <updater> <firmware> <output updater> [index]" } },
+    { "scan",       { cmd_scan,         1, 1, "scan <updater>" } },
+    { "decode-all", { cmd_decode_all,   2, 2, "decode-all <updater dir> <output dir>" } },
+    { "bench",      { cmd_bench,        0, 1, "bench [bytes]" } },
     { "eeprom",     { cmd_eeprom,       1, 2, "eeprom <cmd> [arg]" } },
     { "keymap",     { cmd_keymap,       1, 5, "keymap <cmd> [arg]" } },
+    { "backlight",  { cmd_backlight,    1, 2, "backlight <cmd> [arg]" } },
+    { "snapshot",   { cmd_snapshot,     1, 1, "snapshot <keymap snapshot>" } },
+    { "stats",      { cmd_stats,        1, 2, "stats [--all] <snapshot dir> [keycode]" } },
     { "console",    { cmd_console,      0, 0, "console" } },
 };
 
@@ -566,6 +927,7 @@ int main(int argc, char **argv){
     Param param;
     param.device = DEV_NONE;
     param.ok = options.getOpts().contains(OPT_OK);
+    param.all = options.getOpts().contains(OPT_ALL);
     param.args = options.getArgs();
 
     if(options.getOpts().contains(OPT_TYPE)){
@@ -574,6 +936,17 @@ int main(int argc, char **argv){
             param.device = devnames[type];
     }
 
+    if(options.getOpts().contains(OPT_LAYOUTS)){
+        Keymap::addLayoutPath(options.getOpts()[OPT_LAYOUTS]);
+    }
+
+    if(options.getOpts().contains(OPT_CACHE)){
+        DecodeCache::global().setPath(options.getOpts()[OPT_CACHE]);
+    }
+    if(options.getOpts().contains(OPT_NOCACHE)){
+        DecodeCache::global().setPath(ZPath());
+    }
+
     if(param.args.size()){
         ZString cmstr = param.args[0];
         if(cmds.contains(cmstr)){
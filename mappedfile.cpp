@@ -0,0 +1,106 @@
+#include "mappedfile.h"
+#include "zlog.h"
+
+#if LIBCHAOS_PLATFORM == LIBCHAOS_PLATFORM_WINDOWS
+    #include <windows.h>
+#else
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+
+MappedFile::MappedFile() : opened(false), ptr(nullptr), len(0){
+#if LIBCHAOS_PLATFORM == LIBCHAOS_PLATFORM_WINDOWS
+    file = INVALID_HANDLE_VALUE;
+    mapping = NULL;
+#endif
+}
+
+MappedFile::~MappedFile(){
+    close();
+}
+
+bool MappedFile::open(ZPath path){
+    close();
+    const ZString name = path.str();
+
+#if LIBCHAOS_PLATFORM == LIBCHAOS_PLATFORM_WINDOWS
+    file = CreateFileA(name.cc(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if(file == INVALID_HANDLE_VALUE){
+        ELOG("failed to open " << name);
+        return false;
+    }
+    LARGE_INTEGER fsize;
+    if(!GetFileSizeEx(file, &fsize)){
+        ELOG("failed to stat " << name);
+        CloseHandle(file);
+        file = INVALID_HANDLE_VALUE;
+        return false;
+    }
+    len = fsize.QuadPart;
+    if(len){
+        mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if(mapping)
+            ptr = (zbyte *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        if(!ptr){
+            ELOG("failed to map " << name);
+            if(mapping)
+                CloseHandle(mapping);
+            mapping = NULL;
+            CloseHandle(file);
+            file = INVALID_HANDLE_VALUE;
+            len = 0;
+            return false;
+        }
+    }
+#else
+    int fd = ::open(name.cc(), O_RDONLY);
+    if(fd < 0){
+        ELOG("failed to open " << name);
+        return false;
+    }
+    struct stat st;
+    if(fstat(fd, &st) != 0){
+        ELOG("failed to stat " << name);
+        ::close(fd);
+        return false;
+    }
+    len = st.st_size;
+    if(len){
+        void *map = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, 0);
+        if(map == MAP_FAILED){
+            ELOG("failed to map " << name);
+            ::close(fd);
+            len = 0;
+            return false;
+        }
+        ptr = (zbyte *)map;
+    }
+    // the mapping stays valid without the descriptor
+    ::close(fd);
+#endif
+
+    opened = true;
+    return true;
+}
+
+void MappedFile::close(){
+    if(!opened)
+        return;
+#if LIBCHAOS_PLATFORM == LIBCHAOS_PLATFORM_WINDOWS
+    if(ptr)
+        UnmapViewOfFile(ptr);
+    if(mapping)
+        CloseHandle(mapping);
+    CloseHandle(file);
+    mapping = NULL;
+    file = INVALID_HANDLE_VALUE;
+#else
+    if(ptr)
+        munmap(ptr, len);
+#endif
+    ptr = nullptr;
+    len = 0;
+    opened = false;
+}
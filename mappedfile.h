@@ -0,0 +1,35 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include "zpath.h"
+#include "zbinary.h"
+using namespace LibChaos;
+
+/*! Read-only memory mapping of a whole file.
+ *  The mapping is released on close() or destruction.
+ */
+class MappedFile {
+public:
+    MappedFile();
+    MappedFile(const MappedFile &) = delete;
+    ~MappedFile();
+
+    //! Map the file at \a path. An empty file is mapped with a null data().
+    bool open(ZPath path);
+    void close();
+
+    bool isOpen() const { return opened; }
+    const zbyte *data() const { return ptr; }
+    zu64 size() const { return len; }
+
+private:
+    bool opened;
+    zbyte *ptr;
+    zu64 len;
+#if LIBCHAOS_PLATFORM == LIBCHAOS_PLATFORM_WINDOWS
+    void *file;
+    void *mapping;
+#endif
+};
+
+#endif // MAPPEDFILE_H
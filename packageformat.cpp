@@ -0,0 +1,114 @@
+#include "packageformat.h"
+
+#define UTF16(OFF, LEN)     { OFF, LEN, true }
+#define ASCII(OFF, LEN)     { OFF, LEN, false }
+#define NO_FIELD            { 0, 0, false }
+
+const PackageFormat package_formats[] = {
+    // POK3R
+    {
+        MAAJONSN, "maajonsn", ".maajonsn",
+        0x4B8, CIPHER_PACKAGE, 0,
+        NO_FIELD,                   // description
+        UTF16(0x10, 0x200),         // company
+        UTF16(0x218, 0x200),        // product
+        ASCII(0x460, 12),           // version
+        ASCII(0x4AE, 10),           // signature
+        // one firmware
+        0x420, 0, 1, false,
+        0, PACK_NONE,
+        NO_FIELD, NO_FIELD,
+        UTF16(4, 0x20), 0, 1,
+        SECTIONS_BEFORE_STRINGS, 0, CIPHER_PACKAGE, FIRMWARE_POK3R, false,
+    },
+    // POK3R RGB / Vortex CORE, from IDA disassembly in sub_403830 of v130 updater
+    {
+        MAAV102, "maaV102", ".maaV102",
+        0xB24, CIPHER_PACKAGE, 0,
+        UTF16(0x26, 0x200),         // description
+        UTF16(0x22e, 0x200),        // company
+        UTF16(0x436, 0x200),        // product
+        UTF16(0x63e, 0x200),        // version
+        ASCII(0xb19, 11),           // signature
+        // up to 8 firmwares
+        0xAC8 - (0x50 * 8), 0x50, 8, true,
+        0, 4,
+        NO_FIELD, NO_FIELD,
+        UTF16(8, 0x20), 0, 1,
+        SECTIONS_BEFORE_STRINGS, 0, CIPHER_PACKAGE, FIRMWARE_CYKB, false,
+    },
+    // Vortex Tab 75 / 90, from decompiled FUN_4049d0 of TAB_75_V100
+    {
+        MAAV105, "maaV105", ".maaV105",
+        0x2b58, CIPHER_PACKAGE, 0,
+        UTF16(0x232a, 0x200),       // description
+        UTF16(0x2532, 0x200),       // company
+        UTF16(0x273a, 0x200),       // product
+        UTF16(0x2942, 0x200),       // version
+        ASCII(0x2b58 - 13, 13),     // signature
+        // 4 firmwares, each with a description, version and layout list
+        0xc8, 0x6e0, 4, false,
+        0x410, 0x414,
+        UTF16(0, 0x200), UTF16(0x208, 0x200),
+        UTF16(0x418, 0x200), 80, 9,
+        SECTIONS_AT_OFFSET, 0x1F1600, CIPHER_PACKAGE, FIRMWARE_CYKB, true,
+    },
+    // KBP V60
+    {
+        KBPV60, "kbpV60", nullptr,
+        588, CIPHER_KBP, 0xDA6282CD,
+        NO_FIELD, NO_FIELD, NO_FIELD, NO_FIELD, NO_FIELD,
+        // one firmware
+        4, 0, 1, false,
+        0, PACK_NONE,
+        NO_FIELD, NO_FIELD,
+        NO_FIELD, 0, 0,
+        SECTIONS_AT_OFFSET, 0x54000, CIPHER_KBP, FIRMWARE_POK3R, false,
+    },
+    // KBP V80
+    {
+        KBPV80, "kbpV80", nullptr,
+        588, CIPHER_KBP, 0xF6F3111F,
+        NO_FIELD, NO_FIELD, NO_FIELD, NO_FIELD, NO_FIELD,
+        // one firmware
+        4, 0, 1, false,
+        0, PACK_NONE,
+        NO_FIELD, NO_FIELD,
+        NO_FIELD, 0, 0,
+        SECTIONS_AT_OFFSET, 0x54000, CIPHER_KBP, FIRMWARE_POK3R, false,
+    },
+};
+
+const PackageFormat *findPackageFormat(PackType type){
+    for(zu64 i = 0; i < sizeof(package_formats) / sizeof(PackageFormat); ++i){
+        if(package_formats[i].type == type)
+            return &package_formats[i];
+    }
+    return nullptr;
+}
+
+const PackageFormat *packageFormat(zu64 index){
+    if(index < sizeof(package_formats) / sizeof(PackageFormat))
+        return &package_formats[index];
+    return nullptr;
+}
+
+ZString PackFields::str(const PackField &field, zu64 base) const {
+    const zu64 offset = base + field.offset;
+    if(!field.length || offset >= size)
+        return ZString();
+    ZString str;
+    if(field.utf16){
+        // stop at the end of the section
+        zu64 len = (size - offset) / 2;
+        if(len > field.length)
+            len = field.length;
+        str.parseUTF16((const zu16 *)(data + offset), len);
+    } else {
+        zu64 len = size - offset;
+        if(len > field.length)
+            len = field.length;
+        str = ZString(data + offset, len);
+    }
+    return str;
+}
@@ -0,0 +1,114 @@
+#ifndef PACKAGEFORMAT_H
+#define PACKAGEFORMAT_H
+
+#include "updatepackage.h"
+
+#include "zstring.h"
+#include "zbinary.h"
+using namespace LibChaos;
+
+//! No offset.
+#define PACK_NONE   0xFFFFFFFF
+
+//! Encryption applied to a region of an updater.
+enum PackCipher {
+    CIPHER_NONE = 0,
+    CIPHER_PACKAGE,     //!< decode_package_data()
+    CIPHER_KBP,         //!< kbp_decrypt() with the format key
+};
+
+//! Firmware encryption under the section cipher.
+enum PackFirmware {
+    FIRMWARE_PLAIN = 0,
+    FIRMWARE_POK3R,     //!< ProtoPOK3R::decode_firmware()
+    FIRMWARE_CYKB,      //!< ProtoCYKB::decode_firmware()
+};
+
+//! Where the encoded sections are stored in the exe.
+enum PackSections {
+    SECTIONS_BEFORE_STRINGS,    //!< back to back, ending where the strings section starts
+    SECTIONS_AT_OFFSET,         //!< back to back, from a fixed offset
+};
+
+//! A string field in the decoded strings section.
+struct PackField {
+    zu32 offset;
+    //! Maximum length, in UTF-16 units or bytes. 0 if there is no field.
+    zu32 length;
+    bool utf16;
+};
+
+/*! Description of an updater package format.
+ *  The strings section is at the end of the exe. It holds the package strings
+ *  and a table of firmware entries, each giving the lengths of a firmware section
+ *  and an info section. The sections are stored back to back in table order.
+ */
+struct PackageFormat {
+    PackType type;
+    const char *name;
+    //! Marker in the decoded strings section, null if none.
+    const char *tag;
+
+    zu32 strings_len;
+    PackCipher strings_cipher;
+    //! Key for CIPHER_KBP.
+    zu32 key;
+
+    PackField description;
+    PackField company;
+    PackField product;
+    PackField version;
+    PackField signature;
+
+    //! Firmware table in the strings section.
+    zu32 table_offset;
+    zu32 entry_stride;
+    zu32 entry_count;
+    //! Entries with a zero firmware length are not listed.
+    bool skip_empty;
+    //! Offsets of the section lengths in each entry. No info sections if PACK_NONE.
+    zu32 firmware_len;
+    zu32 info_len;
+    //! Strings in each entry.
+    PackField fw_description;
+    PackField fw_version;
+    //! Up to \a layout_count layout names in each entry, \a layout_stride apart, ending at an empty name.
+    PackField layout;
+    zu32 layout_stride;
+    zu32 layout_count;
+
+    PackSections sections;
+    zu32 sections_offset;
+    PackCipher section_cipher;
+    PackFirmware firmware;
+    //! Output the last non-empty firmware instead of the first.
+    bool output_last;
+};
+
+//! Get the format for \a type, null if none.
+const PackageFormat *findPackageFormat(PackType type);
+//! Get the format at \a index, null past the end of the table.
+const PackageFormat *packageFormat(zu64 index);
+
+/*! Bounds-checked fields read in place from a decoded section.
+ *  Out of range fields read as zero or empty.
+ */
+class PackFields {
+public:
+    PackFields(const zbyte *data, zu64 size) : data(data), size(size){}
+
+    zu32 u32(zu64 offset) const {
+        return (offset <= size && size - offset >= 4) ? ZBinary::decleu32(data + offset) : 0;
+    }
+    zbyte u8(zu64 offset) const {
+        return offset < size ? data[offset] : 0;
+    }
+    //! Read \a field, at \a base plus the field offset.
+    ZString str(const PackField &field, zu64 base = 0) const;
+
+private:
+    const zbyte *data;
+    zu64 size;
+};
+
+#endif // PACKAGEFORMAT_H
@@ -0,0 +1,188 @@
+#include "packagescan.h"
+#include "proto_cykb.h"
+
+#include "zbinary.h"
+#include "zlog.h"
+
+#include <cstring>
+
+#ifdef __SSE2__
+    #include <emmintrin.h>
+#endif
+
+//! Bytes checked for a vector table: initial SP and 15 exception vectors.
+#define VECTOR_LEN  64
+
+const PackageFormat *PackageScanner::probe(const zbyte *exe, zu64 size){
+    ZBinary strs;
+    for(zu64 i = 0; packageFormat(i); ++i){
+        const PackageFormat &fmt = *packageFormat(i);
+        if(size < fmt.strings_len)
+            continue;
+        const zu64 strings_start = size - fmt.strings_len;
+        strs = ZBinary(exe + strings_start, fmt.strings_len);
+
+        if(fmt.strings_cipher == CIPHER_PACKAGE){
+            decode_package_data(strs.raw(), strs.size());
+        } else if(fmt.strings_cipher == CIPHER_KBP){
+            kbp_decrypt(strs.raw(), strs.size(), fmt.key);
+        }
+
+        if(fmt.tag){
+            if(find(strs.raw(), strs.size(), (const zbyte *)fmt.tag, strlen(fmt.tag)) < strs.size())
+                return &fmt;
+        } else if(fmt.sections == SECTIONS_AT_OFFSET && fmt.section_cipher == CIPHER_KBP){
+            // no tag, the firmware length must fit and point at a vector table
+            const zu32 fwl = PackFields(strs.raw(), strs.size()).u32(fmt.table_offset + fmt.firmware_len);
+            if(fwl < VECTOR_LEN || fmt.sections_offset > strings_start || fwl > strings_start - fmt.sections_offset)
+                continue;
+            zbyte vec[VECTOR_LEN];
+            memcpy(vec, exe + fmt.sections_offset, VECTOR_LEN);
+            kbp_decrypt(vec, VECTOR_LEN, fmt.key);
+            if(isVectorTable(vec))
+                return &fmt;
+        }
+    }
+    return nullptr;
+}
+
+void PackageScanner::scan(const zbyte *exe, zu64 size, std::vector<ScanHit> &hits){
+    if(size < VECTOR_LEN)
+        return;
+
+    // CYKB firmware XOR over the vector table
+    ZBinary cykb;
+    cykb.fill(0, VECTOR_LEN);
+    ProtoCYKB::decode_firmware(cykb);
+
+    // package cipher, at each alignment of the 10 byte groups
+    ZBinary buf;
+    buf.resize(size);
+    for(zu64 phase = 0; phase < 10 && phase < size; ++phase){
+        const zu64 len = size - phase;
+        memcpy(buf.raw(), exe + phase, len);
+        decode_package_data(buf.raw(), len);
+        const zbyte *data = buf.raw();
+
+        for(zu64 i = 0; packageFormat(i); ++i){
+            const PackageFormat &fmt = *packageFormat(i);
+            if(!fmt.tag || fmt.strings_cipher != CIPHER_PACKAGE)
+                continue;
+            const zu64 tlen = strlen(fmt.tag);
+            for(zu64 pos = find(data, len, (const zbyte *)fmt.tag, tlen); pos < len; pos = find(data, len, (const zbyte *)fmt.tag, tlen, pos + 1)){
+                ScanHit hit = { ScanHit::SIGNATURE, phase + pos, CIPHER_PACKAGE, FIRMWARE_PLAIN, &fmt, 0, 0 };
+                hits.push_back(hit);
+            }
+        }
+
+        // a section decodes correctly only where it starts on a group in this alignment
+        for(zu64 off = 0; off + VECTOR_LEN <= len; off += 10){
+            const zbyte *vec = data + off;
+            // the stack pointer is in SRAM, 0x20xxxxxx
+            if(vec[3] == 0x20 && isVectorTable(vec)){
+                ScanHit hit = { ScanHit::VECTOR_TABLE, phase + off, CIPHER_PACKAGE, FIRMWARE_PLAIN, nullptr,
+                                ZBinary::decleu32(vec), ZBinary::decleu32(vec + 4) };
+                hits.push_back(hit);
+            }
+            if((vec[3] ^ cykb[3]) == 0x20){
+                zbyte dec[VECTOR_LEN];
+                for(int j = 0; j < VECTOR_LEN; ++j)
+                    dec[j] = vec[j] ^ cykb[j];
+                if(isVectorTable(dec)){
+                    ScanHit hit = { ScanHit::VECTOR_TABLE, phase + off, CIPHER_PACKAGE, FIRMWARE_CYKB, nullptr,
+                                    ZBinary::decleu32(dec), ZBinary::decleu32(dec + 4) };
+                    hits.push_back(hit);
+                }
+            }
+        }
+    }
+
+    // KBP cipher, with each known key
+    for(zu64 i = 0; packageFormat(i); ++i){
+        const PackageFormat &fmt = *packageFormat(i);
+        if(fmt.strings_cipher != CIPHER_KBP)
+            continue;
+        zbyte stream[KBP_STREAM_LEN];
+        kbp_keystream(fmt.key, stream);
+
+        if(size >= fmt.strings_len){
+            const zu64 strings_start = size - fmt.strings_len;
+            ZBinary strs(exe + strings_start, fmt.strings_len);
+            kbp_decrypt(strs.raw(), strs.size(), fmt.key);
+            const zu32 fwl = PackFields(strs.raw(), strs.size()).u32(fmt.table_offset + fmt.firmware_len);
+            if(fwl && fwl <= strings_start){
+                ScanHit hit = { ScanHit::MANIFEST, strings_start, CIPHER_KBP, FIRMWARE_PLAIN, &fmt, fwl, 0 };
+                hits.push_back(hit);
+            }
+        }
+
+        for(zu64 off = 0; off + VECTOR_LEN <= size; ++off){
+            const zbyte *vec = exe + off;
+            if((vec[3] ^ stream[3]) != 0x20)
+                continue;
+            zbyte dec[VECTOR_LEN];
+            for(int j = 0; j < VECTOR_LEN; ++j)
+                dec[j] = vec[j] ^ stream[j];
+            if(isVectorTable(dec)){
+                // POK3R firmware encryption leaves the first packets plain
+                ScanHit hit = { ScanHit::VECTOR_TABLE, off, CIPHER_KBP, FIRMWARE_POK3R, &fmt,
+                                ZBinary::decleu32(dec), ZBinary::decleu32(dec + 4) };
+                hits.push_back(hit);
+            }
+        }
+    }
+}
+
+zu64 PackageScanner::find(const zbyte *data, zu64 size, const zbyte *needle, zu64 len, zu64 pos){
+    if(!len || len > size)
+        return size;
+    const zu64 last = size - len;
+#ifdef __SSE2__
+    // compare the first and last needle bytes at 16 positions at once
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i final = _mm_set1_epi8(needle[len - 1]);
+    for(; pos + 16 <= last + 1; pos += 16){
+        const __m128i a = _mm_loadu_si128((const __m128i *)(data + pos));
+        const __m128i b = _mm_loadu_si128((const __m128i *)(data + pos + len - 1));
+        unsigned mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, final)));
+        while(mask){
+            const unsigned bit = __builtin_ctz(mask);
+            if(memcmp(data + pos + bit, needle, len) == 0)
+                return pos + bit;
+            mask &= mask - 1;
+        }
+    }
+#endif
+    for(; pos <= last; ++pos){
+        if(data[pos] == needle[0] && memcmp(data + pos, needle, len) == 0)
+            return pos;
+    }
+    return size;
+}
+
+bool PackageScanner::isVectorTable(const zbyte *data){
+    // initial stack pointer, word aligned in SRAM
+    const zu32 sp = ZBinary::decleu32(data);
+    if((sp & 0xFFF00000) != 0x20000000 || (sp & 3) || sp == 0x20000000)
+        return false;
+    // reset handler, a thumb address in flash at 0 or 0x08000000
+    const zu32 reset = ZBinary::decleu32(data + 4);
+    const zu32 region = reset & 0xFFF00000;
+    if(!(reset & 1) || (region != 0 && region != 0x08000000))
+        return false;
+
+    int handlers = 0;
+    for(int i = 2; i < 16; ++i){
+        const zu32 vec = ZBinary::decleu32(data + (i * 4));
+        if((i >= 7 && i <= 10) || i == 13){
+            // reserved
+            if(vec)
+                return false;
+        } else if(vec){
+            if(!(vec & 1) || (vec & 0xFFF00000) != region)
+                return false;
+            handlers++;
+        }
+    }
+    return handlers >= 3;
+}
@@ -0,0 +1,53 @@
+#ifndef PACKAGESCAN_H
+#define PACKAGESCAN_H
+
+#include "packageformat.h"
+
+#include "zstring.h"
+using namespace LibChaos;
+
+#include <vector>
+
+//! Something found by PackageScanner in an updater.
+struct ScanHit {
+    enum Kind {
+        SIGNATURE,      //!< format tag in a package-decoded region
+        MANIFEST,       //!< KBP strings section with a plausible firmware length
+        VECTOR_TABLE,   //!< Cortex-M vector table at the start of a decoded region
+    };
+
+    Kind kind;
+    //! Offset in the exe where the decoded region starts matching.
+    zu64 offset;
+    PackCipher cipher;
+    //! Firmware encryption that revealed a vector table.
+    PackFirmware firmware;
+    //! Format whose tag or key matched.
+    const PackageFormat *format;
+    //! Initial stack pointer and reset vector of a vector table, or the KBP firmware length.
+    zu32 value1;
+    zu32 value2;
+};
+
+/*! Heuristics for updaters that are not in the known hash list.
+ *  The package cipher works on 10 byte groups from the start of a section, so
+ *  the whole exe is decoded at each of the 10 alignments and searched for format
+ *  tags and firmware vector tables. KBP sections are tried with each known key.
+ */
+class PackageScanner {
+public:
+    //! Find the format whose strings section at the end of \a exe decodes to its tag
+    //! (or for KBP, to a firmware length pointing at a vector table). Null if none match.
+    static const PackageFormat *probe(const zbyte *exe, zu64 size);
+
+    //! Search all of \a exe.
+    static void scan(const zbyte *exe, zu64 size, std::vector<ScanHit> &hits);
+
+    //! Find \a needle in \a data from \a pos, or \a size if not found.
+    static zu64 find(const zbyte *data, zu64 size, const zbyte *needle, zu64 len, zu64 pos = 0);
+
+    //! Check for a plausible Cortex-M vector table in the first 64 bytes of \a data.
+    static bool isVectorTable(const zbyte *data);
+};
+
+#endif // PACKAGESCAN_H
@@ -34,6 +34,7 @@ ProtoCYKB::~ProtoCYKB(){
 }
 
 bool ProtoCYKB::open(){
+    clearCache();
     // Try firmware vid and pid
     if(dev->open(vid, pid, UPDATE_USAGE_PAGE, UPDATE_USAGE)){
         builtin = false;
@@ -48,6 +49,7 @@ bool ProtoCYKB::open(){
 }
 
 void ProtoCYKB::close(){
+    clearCache();
     dev->close();
 }
 
@@ -505,6 +507,10 @@ zu32 ProtoCYKB::baseFirmwareAddr() const {
     return fw_addr;
 }
 
+zu32 ProtoCYKB::flashSize() const {
+    return FLASH_LEN;
+}
+
 bool ProtoCYKB::sendCmd(zu8 cmd, zu8 a1, ZBinary data){
     if(data.size() > 52){
         ELOG("bad data size");
@@ -90,6 +90,7 @@ public:
 
 private:
     zu32 baseFirmwareAddr() const;
+    zu32 flashSize() const;
     //! Send command
     bool sendCmd(zu8 cmd, zu8 a1, ZBinary data = ZBinary());
     //! Recv command.
@@ -46,6 +46,7 @@ ProtoPOK3R::ProtoPOK3R(zu16 vid_, zu16 pid_, zu16 boot_pid_, bool builtin_, ZPoi
 }
 
 bool ProtoPOK3R::open(){
+    clearCache();
     // Try firmware vid and pid
     if(dev->open(vid, pid, UPDATE_USAGE_PAGE, UPDATE_USAGE)){
         builtin = false;
@@ -60,6 +61,7 @@ bool ProtoPOK3R::open(){
 }
 
 void ProtoPOK3R::close(){
+    clearCache();
     dev->close();
 }
 
@@ -349,6 +351,10 @@ zu32 ProtoPOK3R::baseFirmwareAddr() const {
     return FW_ADDR;
 }
 
+zu32 ProtoPOK3R::flashSize() const {
+    return FLASH_LEN;
+}
+
 bool ProtoPOK3R::sendCmd(zu8 cmd, zu8 subcmd, ZBinary bin){
     if(bin.size() > 60){
         ELOG("bad data size");
@@ -432,7 +438,7 @@ const zu8 swap_key[] = {
     0,2,1,3,
 };
 
-void decode_firmware_packet(zbyte *data, zu32 num){
+void ProtoPOK3R::decode_firmware_packet(zbyte *data, zu32 num){
     zu32 *words = (zu32*)data;
 
     // XOR decryption
@@ -459,15 +465,15 @@ void decode_firmware_packet(zbyte *data, zu32 num){
 // Ripped from the pok3r builtin firmware
 void ProtoPOK3R::decode_firmware(ZBinary &bin){
     zu32 count = 0;
-    for(zu32 offset = 0; offset < bin.size(); offset += 52){
-        if(count >= 10 && count <= 100){
+    for(zu32 offset = 0; offset < bin.size(); offset += FW_PACKET_LEN){
+        if(count >= FW_PACKET_FIRST && count <= FW_PACKET_LAST){
             decode_firmware_packet(bin.raw() + offset, count);
         }
         count++;
     }
 }
 
-void encode_firmware_packet(zbyte *data, zu32 num){
+void ProtoPOK3R::encode_firmware_packet(zbyte *data, zu32 num){
     zu32 *words = (zu32*)data;
 
     // Swap encryption
@@ -494,8 +500,8 @@ void encode_firmware_packet(zbyte *data, zu32 num){
 // Reverse engineered from the above
 void ProtoPOK3R::encode_firmware(ZBinary &bin){
     zu32 count = 0;
-    for(zu32 offset = 0; offset < bin.size(); offset += 52){
-        if(count >= 10 && count <= 100){
+    for(zu32 offset = 0; offset < bin.size(); offset += FW_PACKET_LEN){
+        if(count >= FW_PACKET_FIRST && count <= FW_PACKET_LAST){
             encode_firmware_packet(bin.raw() + offset, count);
         }
         count++;
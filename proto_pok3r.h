@@ -89,14 +89,25 @@ public:
 
 private:
     zu32 baseFirmwareAddr() const;
+    zu32 flashSize() const;
     //! Send command
     bool sendCmd(zu8 cmd, zu8 subcmd, ZBinary bin = ZBinary());
     //! Send command and recv response.
     bool sendRecvCmd(zu8 cmd, zu8 subcmd, ZBinary &data);
 
 public:
+    //! Firmware encryption covers only packets FW_PACKET_FIRST through FW_PACKET_LAST.
+    enum {
+        FW_PACKET_LEN   = 52,
+        FW_PACKET_FIRST = 10,
+        FW_PACKET_LAST  = 100,
+    };
+
     static void decode_firmware(ZBinary &bin);
     static void encode_firmware(ZBinary &bin);
+    //! Decode or encode firmware packet \a num, FW_PACKET_LEN bytes at \a data.
+    static void decode_firmware_packet(zbyte *data, zu32 num);
+    static void encode_firmware_packet(zbyte *data, zu32 num);
 
 private:
     bool builtin;
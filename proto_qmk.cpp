@@ -3,6 +3,8 @@
 #include "keycodes.h"
 #include "zlog.h"
 
+#include <cstring>
+
 #define UPDATE_PKT_LEN      64
 #define UPDATE_ERROR        0xaaff
 
@@ -11,6 +13,12 @@
 #define KM_READ_LAYOUT      0x10000
 #define KM_READ_LSTRS       0x20000
 
+#define EE_RDID_LEN         3
+#define EE_POLL_SLEEP       2
+#define EE_ERASE_TIMEOUT    2000
+
+#define FL_READ_BATCH       64
+
 #define HEX(A) (ZString::ItoS((zu64)(A), 16))
 
 bool ProtoQMK::isQMK() {
@@ -20,7 +28,7 @@ bool ProtoQMK::isQMK() {
 
     //dev->setStream(true);
     ZBinary data;
-    if(!sendRecvCmdQmk(CMD_CTRL, SUB_CT_INFO, data, true)){
+    if(!getQmkInfo(data)){
         //dev->setStream(false);
         return false;
     }
@@ -39,7 +47,7 @@ bool ProtoQMK::isQMK() {
 
 bool ProtoQMK::qmkInfo(){
     ZBinary data;
-    if(!sendRecvCmdQmk(CMD_CTRL, SUB_CT_INFO, data, true)){
+    if(!getQmkInfo(data)){
         return false;
     }
     //LOG(ZLog::RAW << data.dumpBytes(4, 8));
@@ -57,7 +65,7 @@ bool ProtoQMK::qmkInfo(){
 
 ZString ProtoQMK::qmkVersion(){
     ZBinary data;
-    if(!sendRecvCmdQmk(CMD_CTRL, SUB_CT_INFO, data, true)){
+    if(!getQmkInfo(data)){
         return false;
     }
 
@@ -86,6 +94,91 @@ bool ProtoQMK::eepromTest(){
     return true;
 }
 
+bool ProtoQMK::eepromInfo(ZBinary &info){
+    ZBinary data;
+    if(!sendRecvCmdQmk(CMD_EEPROM, SUB_EE_INFO, data))
+        return false;
+    info = data.getSub(0, EE_RDID_LEN);
+    return true;
+}
+
+bool ProtoQMK::waitEEPROM(const ZBinary &rdid, zu32 timeout_ms){
+    // SPI flash ignores RDID while an erase is in progress,
+    // so poll until the expected ID is returned again
+    ZClock clock;
+    while(true){
+        ZBinary data;
+        if(sendRecvCmdQmk(CMD_EEPROM, SUB_EE_INFO, data, true) && data.getSub(0, EE_RDID_LEN) == rdid)
+            return true;
+        if(clock.passedMs(timeout_ms))
+            break;
+        ZThread::msleep(EE_POLL_SLEEP);
+    }
+    ELOG("eeprom busy timeout");
+    return false;
+}
+
+bool ProtoQMK::isEEPROMBlank(zu32 addr, zu32 len, bool &blank){
+    // read the whole range pipelined, like dumpFlashQMK
+    ZArray<ZBinary> reqs;
+    for(zu32 off = 0; off < len; off += 60){
+        ZBinary data;
+        data.writeleu32(addr + off);
+        reqs.push(data);
+    }
+    if(!sendRecvCmdQmkPipelined(CMD_EEPROM, SUB_EE_READ, reqs))
+        return false;
+
+    blank = true;
+    for(zsize j = 0; j < reqs.size(); ++j){
+        const zu32 off = j * 60;
+        const zu64 n = MIN((zu64)(len - off), reqs[j].size());
+        for(zu64 i = 0; i < n; ++i){
+            if(reqs[j][i] != 0xFF){
+                blank = false;
+                return true;
+            }
+        }
+    }
+    return true;
+}
+
+bool ProtoQMK::wipeEEPROM(){
+    ZBinary rdid;
+    if(!eepromInfo(rdid))
+        return false;
+
+    ZBinary ff;
+    ff.fill(0xFF, EE_RDID_LEN);
+    ZBinary zero;
+    zero.fill(0, EE_RDID_LEN);
+    if(rdid == ff || rdid == zero){
+        ELOG("eeprom not responding");
+        return false;
+    }
+    DLOG("eeprom id " << rdid.dumpBytes(1, 8));
+
+    zu32 erased = 0;
+    for(zu32 addr = 0; addr < EEPROM_LEN; addr += QMK_EE_PAGE_SIZE){
+        bool blank;
+        if(!isEEPROMBlank(addr, QMK_EE_PAGE_SIZE, blank))
+            return false;
+        if(blank){
+            DLOG("skip blank page " << HEX(addr));
+            continue;
+        }
+
+        LOG("Erase 0x" << HEX(addr));
+        if(!eraseEEPROM(addr))
+            return false;
+        if(!waitEEPROM(rdid, EE_ERASE_TIMEOUT))
+            return false;
+        erased++;
+    }
+    LOG("Erased " << erased << " of " << (EEPROM_LEN / QMK_EE_PAGE_SIZE) << " pages");
+    return true;
+}
+
 ZBinary ProtoQMK::dumpEEPROM(){
     ZBinary dump;
     zu32 cp = EEPROM_LEN / 10;
@@ -124,9 +217,8 @@ bool ProtoQMK::keymapDump(){
 
 ZBinary ProtoQMK::getMatrix(){
     DLOG("loadKeymap");
-    // Send command
     ZBinary data;
-    if(!sendRecvCmdQmk(CMD_KEYMAP, SUB_KM_INFO, data))
+    if(!getKeymapInfo(data))
         return nullptr;
 
     const zu8 layers = data[0];
@@ -156,7 +248,8 @@ ZBinary ProtoQMK::getMatrix(){
 ZPointer<Keymap> ProtoQMK::loadKeymap(){
     DLOG("loadKeymap");
     ZBinary data;
-    getKeymapInfo(data);
+    if(!getKeymapInfo(data))
+        return nullptr;
 
     const zu8 layers = data[0];
     const zu8 rows = data[1];
@@ -202,6 +295,8 @@ ZPointer<Keymap> ProtoQMK::loadKeymap(){
         keymap->loadLayerMap(dump);
     }
     cachedMatrix = matrices;
+    keymap->clearDirty();
+    synced_id = keymap->syncId();
 
     return keymap;
 }
@@ -209,42 +304,138 @@ ZPointer<Keymap> ProtoQMK::loadKeymap(){
 bool ProtoQMK::uploadKeymap(ZPointer<Keymap> keymap){
     DLOG("uploadKeymap");
 
-    ZBinary dump = cachedMatrix;
-    // use cached matrix if possible
-    if(!dump.size())
-        dump = getMatrix();
-    //RLOG(dump.dumpBytes(2, 16));
-
-    ZBinary map = keymap->toMatrix();
+    const ZBinary &map = keymap->matrixData();
     //LOG("Writing " << map.size() << " matrix bytes");
     //RLOG(map.dumpBytes(2, 16));
 
-    ZBinary diff;
-    zu64 offset = dump.subDiff(map, diff);
-    zassert(offset != ZU64_MAX, "invalid diff");
-    LOG("Keymap Diff:");
-    RLOG(diff.dumpBytes(2, 16, offset));
-
-    for(zu32 off = 0; off < diff.size(); off += 56){
-        ZBinary bin;
-        diff.read(bin, 56);
-        //RLOG(bin.dumpBytes(2, 16));
-        if(!writeKeymap(offset + off, bin))
+    ZArray<Region> regions;
+    ZArray<zu32> dirty;
+    if(synced_id && keymap->syncId() == synced_id && cachedMatrix.size() == map.size() && keymap->dirtyOffsets(dirty)){
+        // only cells changed since the keymap was loaded or uploaded
+        regions = offsetRegions(dirty, sizeof(Keymap::keycode), diff_gap);
+        LOG("Keymap Changes: " << dirty.size() << " keys, " << regions.size() << " regions");
+    } else {
+        ZBinary dump = cachedMatrix;
+        // use cached matrix if possible
+        if(!dump.size())
+            dump = getMatrix();
+        //RLOG(dump.dumpBytes(2, 16));
+
+        // keycodes are 16 bits, never split one across regions
+        regions = diffRegions(dump, map, diff_gap, sizeof(Keymap::keycode));
+        LOG("Keymap Diff: " << regions.size() << " regions");
+    }
+
+    for(zsize i = 0; i < regions.size(); ++i){
+        RLOG(map.getSub(regions[i].offset, regions[i].size).dumpBytes(2, 16, regions[i].offset));
+    }
+
+    ZArray<ZBinary> packets;
+    regionPackets(map, regions, packets);
+
+    if(packets.size()){
+        DLOG("writeKeymap " << packets.size() << " packets");
+        if(!sendRecvCmdQmkPipelined(CMD_KEYMAP, SUB_KM_WRITE, packets))
             return false;
     }
 
     // update cached matrix
-    cachedMatrix = map;
+    if(cachedMatrix.size() == map.size()){
+        for(zsize i = 0; i < regions.size(); ++i)
+            memcpy(cachedMatrix.raw() + regions[i].offset, map.raw() + regions[i].offset, regions[i].size);
+    } else {
+        cachedMatrix = map;
+    }
+    keymap->clearDirty();
+    synced_id = keymap->syncId();
     return true;
 }
 
+ZArray<ProtoQMK::Region> ProtoQMK::offsetRegions(const ZArray<zu32> &offsets, zu32 size, zu32 gap){
+    ZArray<Region> regions;
+    for(zsize i = 0; i < offsets.size(); ++i){
+        const zu32 start = offsets[i];
+        if(regions.size()){
+            Region &prev = regions[regions.size() - 1];
+            if(start <= prev.offset + prev.size + gap){
+                if(start + size > prev.offset + prev.size)
+                    prev.size = start + size - prev.offset;
+                continue;
+            }
+        }
+        Region reg;
+        reg.offset = start;
+        reg.size = size;
+        regions.push(reg);
+    }
+    return regions;
+}
+
+ZArray<ProtoQMK::Region> ProtoQMK::diffRegions(const ZBinary &a, const ZBinary &b, zu32 gap, zu32 align){
+    ZArray<Region> regions;
+    const zbyte *pa = a.raw();
+    const zbyte *pb = b.raw();
+    const zu64 asize = a.size();
+    const zu64 bsize = b.size();
+
+    zu64 i = 0;
+    while(i < bsize){
+        if(i < asize && pa[i] == pb[i]){
+            ++i;
+            continue;
+        }
+
+        // extend region until more than gap equal bytes
+        zu64 last = i;
+        zu32 run = 0;
+        for(zu64 j = i + 1; j < bsize; ++j){
+            if(j >= asize || pa[j] != pb[j]){
+                last = j;
+                run = 0;
+            } else if(++run > gap){
+                break;
+            }
+        }
+
+        zu64 start = i - (i % align);
+        zu64 end = last + 1;
+        if(end % align)
+            end += align - (end % align);
+        end = MIN(end, bsize);
+
+        // alignment may join adjacent regions
+        if(regions.size() && start <= regions[regions.size() - 1].offset + regions[regions.size() - 1].size){
+            Region &prev = regions[regions.size() - 1];
+            prev.size = end - prev.offset;
+        } else {
+            Region reg;
+            reg.offset = start;
+            reg.size = end - start;
+            regions.push(reg);
+        }
+        i = end;
+    }
+    return regions;
+}
+
 bool ProtoQMK::getKeymapInfo(ZBinary &info){
-    if(!sendRecvCmdQmk(CMD_KEYMAP, SUB_KM_INFO, info))
-        return false;
+    if(!cached_kminfo.size()){
+        ZBinary data;
+        if(!sendRecvCmdQmk(CMD_KEYMAP, SUB_KM_INFO, data))
+            return false;
+        cached_kminfo = data;
+    }
+    info = cached_kminfo;
+    info.rewind();
     return true;
 }
 
 bool ProtoQMK::getLayouts(ZArray<ZString> &layouts){
+    if(cached_layouts.size()){
+        layouts = cached_layouts;
+        return true;
+    }
+
     // Read layout strs
     ZBinary lstr;
     for(zu32 off = 0; true; off += 60){
@@ -265,12 +456,16 @@ bool ProtoQMK::getLayouts(ZArray<ZString> &layouts){
     }
     lstr.nullTerm();
     layouts = ZString(lstr.asChar()).explode(',');
+    cached_layouts = layouts;
     return true;
 }
 
 bool ProtoQMK::setLayout(zu8 layout){
     ZBinary data;
     data.writeu8(layout);
+    // current layout is part of keymap info
+    cached_kminfo.clear();
+    cachedMatrix.clear();
     if(!sendRecvCmdQmk(CMD_CTRL, SUB_CT_LAYOUT, data))
         return false;
     return true;
@@ -308,6 +503,110 @@ bool ProtoQMK::eraseEEPROM(zu32 addr){
     return true;
 }
 
+bool ProtoQMK::readFlashQMK(zu32 addr, ZBinary &bin){
+    DLOG("readFlashQMK " << HEX(addr));
+    // Send command
+    ZBinary data;
+    data.writeleu32(addr);
+    if(!sendRecvCmdQmk(CMD_FLASH_QMK, SUB_FL_READ, data))
+        return false;
+    bin.write(data);
+    return true;
+}
+
+bool ProtoQMK::dumpFlashQMK(std::function<bool(const ZBinary &)> func){
+    const zu32 len = flashSize();
+    zu32 cp = len / 10;
+    int perc = 0;
+    RLOG(perc << "%...");
+
+    for(zu32 addr = 0; addr < len;){
+        // read a batch of packets pipelined
+        ZArray<ZBinary> reqs;
+        for(zu32 i = 0; i < FL_READ_BATCH && addr + (i * 60) < len; ++i){
+            ZBinary data;
+            data.writeleu32(addr + (i * 60));
+            reqs.push(data);
+        }
+        if(!sendRecvCmdQmkPipelined(CMD_FLASH_QMK, SUB_FL_READ, reqs)){
+            RLOG(ZLog::NEWLN);
+            return false;
+        }
+
+        ZBinary chunk;
+        for(zsize i = 0; i < reqs.size(); ++i){
+            chunk.write(reqs[i]);
+        }
+        addr += reqs.size() * 60;
+        // last packet reads past the end of flash
+        if(addr > len)
+            chunk.resize(chunk.size() - (addr - len));
+
+        if(!func(chunk)){
+            RLOG(ZLog::NEWLN);
+            return false;
+        }
+
+        while(addr >= cp && perc < 100){
+            perc += 10;
+            RLOG(perc << "%...");
+            cp += len / 10;
+        }
+    }
+    RLOG(ZLog::NEWLN);
+
+    return true;
+}
+
+bool ProtoQMK::getBacklightInfo(ZBinary &info){
+    if(!sendRecvCmdQmk(CMD_BACKLIGHT, SUB_BL_INFO, info))
+        return false;
+    return true;
+}
+
+bool ProtoQMK::readBacklight(zu32 offset, ZBinary &bin){
+    DLOG("readBacklight " << HEX(offset));
+    // Send command
+    ZBinary data;
+    data.writeleu32(offset);
+    if(!sendRecvCmdQmk(CMD_BACKLIGHT, SUB_BL_READ, data))
+        return false;
+    bin.write(data);
+    return true;
+}
+
+bool ProtoQMK::writeBacklight(zu16 offset, ZBinary bin){
+    if(bin.size() > 56){
+        ELOG("backlight write too large");
+        return false;
+    }
+    DLOG("writeBacklight " << offset << " " << bin.size());
+    // Send command
+    ZBinary data;
+    data.writeleu16(offset);
+    data.writeleu16(bin.size());
+    data.write(bin);
+    if(!sendRecvCmdQmk(CMD_BACKLIGHT, SUB_BL_WRITE, data))
+        return false;
+    return true;
+}
+
+bool ProtoQMK::writeBacklightRegions(const ZBinary &map, const ZArray<Region> &regions){
+    ZArray<ZBinary> packets;
+    regionPackets(map, regions, packets);
+    if(!packets.size())
+        return true;
+    DLOG("writeBacklight " << packets.size() << " packets");
+    return sendRecvCmdQmkPipelined(CMD_BACKLIGHT, SUB_BL_WRITE, packets);
+}
+
+bool ProtoQMK::commitBacklight(){
+    ZBinary data;
+    if(!sendRecvCmdQmk(CMD_BACKLIGHT, SUB_BL_COMMIT, data))
+        return false;
+    return true;
+}
+
 bool ProtoQMK::readKeymap(zu32 offset, ZBinary &bin){
     DLOG("readKeymap " << HEX(offset));
     // Send command
@@ -344,6 +643,8 @@ bool ProtoQMK::commitKeymap(){
 
 bool ProtoQMK::reloadKeymap(){
     ZBinary data;
+    cached_kminfo.clear();
+    cachedMatrix.clear();
     if(!sendRecvCmdQmk(CMD_KEYMAP, SUB_KM_RELOAD, data))
         return false;
     return true;
@@ -351,23 +652,53 @@ bool ProtoQMK::reloadKeymap(){
 
 bool ProtoQMK::resetKeymap(){
     ZBinary data;
+    cached_kminfo.clear();
+    cachedMatrix.clear();
     if(!sendRecvCmdQmk(CMD_KEYMAP, SUB_KM_RESET, data))
         return false;
     return true;
 }
 
-bool ProtoQMK::sendRecvCmdQmk(zu8 cmd, zu8 subcmd, ZBinary &data, bool quiet){
-    if(data.size() > 60){
-        ELOG("bad data size");
-        return false;
+void ProtoQMK::clearCache(){
+    cachedMatrix.clear();
+    synced_id = 0;
+    cached_qmkinfo.clear();
+    cached_kminfo.clear();
+    cached_layouts.clear();
+}
+
+bool ProtoQMK::getQmkInfo(ZBinary &info){
+    if(!cached_qmkinfo.size()){
+        ZBinary data;
+        if(!sendRecvCmdQmk(CMD_CTRL, SUB_CT_INFO, data, true))
+            return false;
+        // the command fails quietly on stock firmware, only cache real info
+        ArZ fields = ZString(data.raw() + 4, 56).explode(';');
+        if(fields.size() < 1 || fields[0] != "qmk_pok3r"){
+            info = data;
+            info.rewind();
+            return true;
+        }
+        cached_qmkinfo = data;
     }
+    info = cached_qmkinfo;
+    info.rewind();
+    return true;
+}
 
-    // discard any unread data
+void ProtoQMK::discardRecv(){
     ZBinary tmp_buff;
     while(dev->recv(tmp_buff)){
         DLOG("discard recv");
         DLOG(ZLog::RAW << tmp_buff.dumpBytes(4, 8));
     }
+}
+
+bool ProtoQMK::sendCmdQmk(zu8 cmd, zu8 subcmd, const ZBinary &data, zu16 &crc){
+    if(data.size() > 60){
+        ELOG("bad data size");
+        return false;
+    }
 
     ZBinary pkt_out(UPDATE_PKT_LEN);
     pkt_out.fill(0);
@@ -377,8 +708,8 @@ bool ProtoQMK::sendRecvCmdQmk(zu8 cmd, zu8 subcmd, ZBinary &data, bool quiet){
     pkt_out.write(data);      // data
 
     pkt_out.seek(2);
-    zu16 crc_out = ZHash<ZBinary, ZHashBase::CRC16>(pkt_out).hash();
-    pkt_out.writeleu16(crc_out); // CRC
+    crc = ZHash<ZBinary, ZHashBase::CRC16>(pkt_out).hash();
+    pkt_out.writeleu16(crc); // CRC
 
     DLOG("send:");
     DLOG(ZLog::RAW << pkt_out.dumpBytes(4, 8));
@@ -388,7 +719,10 @@ bool ProtoQMK::sendRecvCmdQmk(zu8 cmd, zu8 subcmd, ZBinary &data, bool quiet){
         ELOG("send error");
         return false;
     }
+    return true;
+}
 
+bool ProtoQMK::recvCmdQmk(zu16 crc_out, ZBinary &data, bool quiet){
     // Recv packet
     ZBinary pkt_in;
     pkt_in.resize(UPDATE_PKT_LEN);
@@ -405,6 +739,7 @@ bool ProtoQMK::sendRecvCmdQmk(zu8 cmd, zu8 subcmd, ZBinary &data, bool quiet){
         return false;
     }
 
+    data.clear();
     pkt_in.seek(4);
     pkt_in.read(data, 60); // read data
     data.rewind();
@@ -437,3 +772,50 @@ bool ProtoQMK::sendRecvCmdQmk(zu8 cmd, zu8 subcmd, ZBinary &data, bool quiet){
 
     return true;
 }
+
+bool ProtoQMK::sendRecvCmdQmk(zu8 cmd, zu8 subcmd, ZBinary &data, bool quiet){
+    // discard any unread data
+    discardRecv();
+
+    zu16 crc_out;
+    if(!sendCmdQmk(cmd, subcmd, data, crc_out))
+        return false;
+    return recvCmdQmk(crc_out, data, quiet);
+}
+
+void ProtoQMK::regionPackets(const ZBinary &map, const ZArray<Region> &regions, ZArray<ZBinary> &packets){
+    for(zsize i = 0; i < regions.size(); ++i){
+        const Region reg = regions[i];
+        for(zu32 off = 0; off < reg.size; off += 56){
+            const zu16 len = MIN(reg.size - off, 56U);
+            ZBinary data;
+            data.writeleu16(reg.offset + off);
+            data.writeleu16(len);
+            data.write(map.raw() + reg.offset + off, len);
+            packets.push(data);
+        }
+    }
+}
+
+bool ProtoQMK::sendRecvCmdQmkPipelined(zu8 cmd, zu8 subcmd, ZArray<ZBinary> &data){
+    // discard any unread data
+    discardRecv();
+
+    // responses come back in order, so keep a window of
+    // sent requests and match each response to the oldest
+    ZArray<zu16> crcs;
+    crcs.resize(data.size());
+    zsize sent = 0;
+    zsize done = 0;
+    while(done < data.size()){
+        while(sent < data.size() && sent - done < QMK_PIPELINE_DEPTH){
+            if(!sendCmdQmk(cmd, subcmd, data[sent], crcs[sent]))
+                return false;
+            ++sent;
+        }
+        if(!recvCmdQmk(crcs[done], data[done]))
+            return false;
+        ++done;
+    }
+    return true;
+}
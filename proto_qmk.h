@@ -5,6 +5,8 @@
 #include "keymap.h"
 #include "rawhid/hiddevice.h"
 
+#include <functional>
+
 #include "zstring.h"
 #include "zbinary.h"
 using namespace LibChaos;
@@ -13,6 +15,11 @@ using namespace LibChaos;
 #define QMK_EE_CONF_PAGE 0x0
 #define QMK_EE_KEYM_PAGE 0x1000
 
+//! Default number of unchanged bytes merged into a keymap diff region.
+#define QMK_DIFF_GAP        8
+//! Max number of commands in flight when pipelining.
+#define QMK_PIPELINE_DEPTH  4
+
 class ProtoQMK : public KBProto {
 public:
     enum qmk_cmd {
@@ -47,8 +54,14 @@ public:
         SUB_FL_READ     = 0,    //!< Read flash data.
     };
 
+    //! Byte range of a binary diff.
+    struct Region {
+        zu32 offset;
+        zu32 size;
+    };
+
 protected:
-    ProtoQMK(KBType type, ZPointer<HIDDevice> dev) : KBProto(type), dev(dev){}
+    ProtoQMK(KBType type, ZPointer<HIDDevice> dev) : KBProto(type), dev(dev), diff_gap(QMK_DIFF_GAP), synced_id(0){}
 public:
     virtual ~ProtoQMK(){}
 
@@ -59,6 +72,14 @@ public:
     ZString qmkVersion();
 
     bool eepromTest();
+    //! Get EEPROM info (SPI RDID response).
+    bool eepromInfo(ZBinary &info);
+    //! Wait until the EEPROM answers RDID with \a rdid again, after an erase.
+    bool waitEEPROM(const ZBinary &rdid, zu32 timeout_ms);
+    //! Check if \a len bytes at \a addr are erased.
+    bool isEEPROMBlank(zu32 addr, zu32 len, bool &blank);
+    //! Erase all non-blank EEPROM pages.
+    bool wipeEEPROM();
 
     //! Dump the contents of external flash / eeprom.
     ZBinary dumpEEPROM();
@@ -68,6 +89,15 @@ public:
     ZBinary getMatrix();
     ZPointer<Keymap> loadKeymap();
     bool uploadKeymap(ZPointer<Keymap> keymap);
+    //! Set the max number of unchanged bytes merged into one keymap diff region.
+    void setDiffGap(zu32 gap){ diff_gap = gap; }
+
+    //! Get the disjoint regions where \a b differs from \a a.
+    //! Regions separated by \a gap or fewer equal bytes are merged, and aligned to \a align bytes.
+    static ZArray<Region> diffRegions(const ZBinary &a, const ZBinary &b, zu32 gap, zu32 align = 1);
+    //! Get the regions covering \a size bytes at each of the sorted \a offsets.
+    //! Regions separated by \a gap or fewer bytes are merged.
+    static ZArray<Region> offsetRegions(const ZArray<zu32> &offsets, zu32 size, zu32 gap);
 
     bool getKeymapInfo(ZBinary &info);
 
@@ -78,6 +108,20 @@ public:
     bool writeEEPROM(zu32 addr, ZBinary bin);
     bool eraseEEPROM(zu32 addr);
 
+    //! Read 60 bytes of flash at \a addr from QMK firmware.
+    bool readFlashQMK(zu32 addr, ZBinary &bin);
+    //! Dump the contents of flash from QMK firmware, without rebooting to the bootloader.
+    //! Each chunk read is passed to \a func in order, return false from \a func to stop.
+    bool dumpFlashQMK(std::function<bool(const ZBinary &)> func);
+
+    //! Get backlight map info (layers, rows, cols, type size).
+    bool getBacklightInfo(ZBinary &info);
+    bool readBacklight(zu32 offset, ZBinary &bin);
+    bool writeBacklight(zu16 offset, ZBinary bin);
+    //! Write \a regions of backlight map \a map, pipelined.
+    bool writeBacklightRegions(const ZBinary &map, const ZArray<Region> &regions);
+    bool commitBacklight();
+
     bool readKeymap(zu32 offset, ZBinary &bin);
     bool writeKeymap(zu16 offset, ZBinary bin);
     bool commitKeymap();
@@ -86,13 +130,38 @@ public:
 
 protected:
     virtual zu32 baseFirmwareAddr() const = 0;
+    virtual zu32 flashSize() const = 0;
+    //! Forget all device info cached during this session.
+    void clearCache();
 
 private:
+    //! Get firmware info (SUB_CT_INFO), cached once the firmware is known to be QMK.
+    bool getQmkInfo(ZBinary &info);
+    //! Discard any unread responses.
+    void discardRecv();
+    //! Send command, \a crc is set to the CRC of the sent packet.
+    bool sendCmdQmk(zu8 cmd, zu8 subcmd, const ZBinary &data, zu16 &crc);
+    //! Recv response to the command sent with \a crc.
+    bool recvCmdQmk(zu16 crc, ZBinary &data, bool quiet = false);
     bool sendRecvCmdQmk(zu8 cmd, zu8 subcmd, ZBinary &data, bool quiet = false);
+    //! Send a command for each of \a data, with up to QMK_PIPELINE_DEPTH in flight.
+    //! Each of \a data is replaced by its response.
+    bool sendRecvCmdQmkPipelined(zu8 cmd, zu8 subcmd, ZArray<ZBinary> &data);
+    //! Make write packets (offset, size, data) for \a regions of \a map.
+    static void regionPackets(const ZBinary &map, const ZArray<Region> &regions, ZArray<ZBinary> &packets);
 
 protected:
     ZPointer<HIDDevice> dev;
     ZBinary cachedMatrix;
+    zu32 diff_gap;
+    //! Keymap::syncId() of the keymap last loaded from or uploaded to cachedMatrix, 0 if none.
+    zu64 synced_id;
+
+private:
+    //! Per-session caches, see clearCache().
+    ZBinary cached_qmkinfo;
+    ZBinary cached_kminfo;
+    ZArray<ZString> cached_layouts;
 };
 
 #endif // PROTO_QMK_H
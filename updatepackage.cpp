@@ -1,28 +1,45 @@
 #include "updatepackage.h"
 #include "proto_pok3r.h"
 #include "proto_cykb.h"
+#include "mappedfile.h"
+#include "fileutil.h"
+#include "decodecache.h"
+#include "packageformat.h"
+#include "packagescan.h"
 
 #include "zfile.h"
 #include "zhash.h"
+#include "zthread.h"
 #include "zmap.h"
 #include "zlog.h"
 
-typedef int (*decodeFunc)(ZFile *, ZBinary &);
-int decode_maajonsn(ZFile *file, ZBinary &fw_out);
-int decode_maav102(ZFile *file, ZBinary &fw_out);
-int decode_maav105(ZFile *file, ZBinary &fw_out);
-int decode_kbp_v60(ZFile *file, ZBinary &fw_out);
-int decode_kbp_v80(ZFile *file, ZBinary &fw_out);
-
-enum PackType {
-    PACKAGE_NONE = 0,
-    MAAJONSN,   // .maajonsn
-    MAAV102,    // .maaV102
-    MAAV105,    // .maaV105
-    KBPV60,
-    KBPV80,
+#include <cstring>
+#include <cstdio>
+#include <chrono>
+
+#ifdef __SSE2__
+    #include <emmintrin.h>
+#endif
+
+#include <thread>
+#include <atomic>
+#include <vector>
+
+//! Position of one firmware table entry and its sections in an updater.
+struct PackSection {
+    //! Offset of the entry in the strings section.
+    zu64 entry;
+    zu64 firmware_pos;
+    zu32 firmware_len;
+    zu64 info_pos;
+    zu32 info_len;
 };
 
+int decode_package(const PackageFormat &fmt, const zbyte *exe, zu64 exelen, ZBinary &strs, PackageInfo &info);
+int package_layout(const PackageFormat &fmt, const PackFields &fields, zu64 strings_start, ZArray<PackSection> &sections);
+zu64 package_output(const PackageFormat &fmt, const ZArray<PackSection> &sections);
+bool pkg_slice(const zbyte *exe, zu64 exelen, zu64 pos, zu64 len, ZBinary &out);
+
 const ZMap<zu64, PackType> packages = {
     // POK3R (141)
     { 0x62FCF913A689C9AE,   MAAJONSN }, // V1.1.3
@@ -87,40 +104,425 @@ const ZMap<zu64, PackType> packages = {
     { 0x58B42FF4B1C57C09,   MAAV102 },  // V1.01.02     md200/v112
 };
 
-const ZMap<PackType, decodeFunc> types = {
-    { MAAJONSN, decode_maajonsn },
-    { MAAV102,  decode_maav102 },
-    { KBPV60,   decode_kbp_v60 },
-    { KBPV80,   decode_kbp_v80 },
-    { MAAV105,  decode_maav105 },
+//! Fingerprints of the updaters above, printed by `pok3rtool identify --all`.
+//! An updater without one here is still identified, after hashing the whole file once.
+static const PackageFingerprint known_fingerprints[] = {
+    // size,                trailer,                sample,                 hash
+    { 0, 0, 0, 0 },
 };
 
+//! Bytes at the end of an updater hashed for its fingerprint, covering every strings section.
+#define FINGERPRINT_LEN 0x3000
+//! Blocks hashed from the rest of an updater to confirm a fingerprint.
+#define SAMPLE_BLOCKS   64
+#define SAMPLE_LEN      256
+
+#define FNV_OFFSET      0xcbf29ce484222325ULL
+
+// FNV-1a
+static zu64 fnv_hash(const zbyte *data, zu64 size, zu64 hash = FNV_OFFSET){
+    for(zu64 i = 0; i < size; ++i){
+        hash ^= data[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+// Hash the last FINGERPRINT_LEN bytes of the mapped file
+static zu64 exe_trailer(const zbyte *exe, zu64 size){
+    const zu64 len = size < FINGERPRINT_LEN ? size : FINGERPRINT_LEN;
+    return fnv_hash(exe + size - len, len);
+}
+
+// Hash SAMPLE_BLOCKS evenly spaced blocks of the mapped file before the trailer
+static zu64 exe_sample(const zbyte *exe, zu64 size){
+    const zu64 len = size < FINGERPRINT_LEN ? 0 : size - FINGERPRINT_LEN;
+    if(len <= SAMPLE_BLOCKS * SAMPLE_LEN)
+        return fnv_hash(exe, len);
+    const zu64 step = (len - SAMPLE_LEN) / (SAMPLE_BLOCKS - 1);
+    zu64 hash = FNV_OFFSET;
+    for(zu64 i = 0; i < SAMPLE_BLOCKS; ++i)
+        hash = fnv_hash(exe + i * step, SAMPLE_LEN, hash);
+    return hash;
+}
+
+#define XXH_PRIME1  0x9E3779B185EBCA87ULL
+#define XXH_PRIME2  0xC2B2AE3D27D4EB4FULL
+#define XXH_PRIME3  0x165667B19E3779F9ULL
+#define XXH_PRIME4  0x85EBCA77C2B2AE63ULL
+#define XXH_PRIME5  0x27D4EB2F165667C5ULL
+
+static inline zu64 xxh_rotl(zu64 x, int r){
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline zu64 xxh_round(zu64 acc, zu64 input){
+    acc += input * XXH_PRIME2;
+    return xxh_rotl(acc, 31) * XXH_PRIME1;
+}
+
+static inline zu64 xxh_merge(zu64 acc, zu64 val){
+    acc ^= xxh_round(0, val);
+    return acc * XXH_PRIME1 + XXH_PRIME4;
+}
+
+// XXH64 with seed 0
+static zu64 xxh64(const zbyte *data, zu64 size){
+    const zbyte *end = data + size;
+    zu64 hash;
+    if(size >= 32){
+        zu64 v1 = XXH_PRIME1 + XXH_PRIME2;
+        zu64 v2 = XXH_PRIME2;
+        zu64 v3 = 0;
+        zu64 v4 = 0 - XXH_PRIME1;
+        for(; data + 32 <= end; data += 32){
+            v1 = xxh_round(v1, ZBinary::decleu64(data));
+            v2 = xxh_round(v2, ZBinary::decleu64(data + 8));
+            v3 = xxh_round(v3, ZBinary::decleu64(data + 16));
+            v4 = xxh_round(v4, ZBinary::decleu64(data + 24));
+        }
+        hash = xxh_rotl(v1, 1) + xxh_rotl(v2, 7) + xxh_rotl(v3, 12) + xxh_rotl(v4, 18);
+        hash = xxh_merge(hash, v1);
+        hash = xxh_merge(hash, v2);
+        hash = xxh_merge(hash, v3);
+        hash = xxh_merge(hash, v4);
+    } else {
+        hash = XXH_PRIME5;
+    }
+    hash += size;
+
+    for(; data + 8 <= end; data += 8){
+        hash ^= xxh_round(0, ZBinary::decleu64(data));
+        hash = xxh_rotl(hash, 27) * XXH_PRIME1 + XXH_PRIME4;
+    }
+    if(data + 4 <= end){
+        hash ^= (zu64)ZBinary::decleu32(data) * XXH_PRIME1;
+        hash = xxh_rotl(hash, 23) * XXH_PRIME2 + XXH_PRIME3;
+        data += 4;
+    }
+    for(; data < end; ++data){
+        hash ^= *data * XXH_PRIME5;
+        hash = xxh_rotl(hash, 11) * XXH_PRIME1;
+    }
+
+    hash ^= hash >> 33;
+    hash *= XXH_PRIME2;
+    hash ^= hash >> 29;
+    hash *= XXH_PRIME3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+// Same hash as ZFile::fileHash(), straight from the mapped file
+static zu64 exe_hash(const MappedFile &file){
+    return xxh64(file.data(), file.size());
+}
+
+static const PackageFingerprint *find_known_fingerprint(zu64 size, zu64 trailer){
+    for(const PackageFingerprint *fp = known_fingerprints; fp->size; ++fp){
+        if(fp->size == size && fp->trailer == trailer)
+            return fp;
+    }
+    return nullptr;
+}
+
+// True if every updater in packages has a built-in fingerprint
+static bool fingerprints_complete(){
+    static const bool complete = []{
+        for(auto it = packages.begin(); it.more(); ++it){
+            bool found = false;
+            for(const PackageFingerprint *fp = known_fingerprints; fp->size && !found; ++fp)
+                found = (fp->hash == it.get());
+            if(!found)
+                return false;
+        }
+        return true;
+    }();
+    return complete;
+}
+
+// Remember the fingerprint of a file hashed in full, if it has none yet
+static void add_fingerprint(zu64 exehash, const zbyte *exe, zu64 size){
+    const zu64 trailer = exe_trailer(exe, size);
+    const PackageFingerprint *known = find_known_fingerprint(size, trailer);
+    if(known && known->hash == exehash)
+        return;
+    zu64 hash, sample;
+    if(DecodeCache::global().findFingerprint(size, trailer, hash, sample) && hash == exehash)
+        return;
+    DecodeCache::global().addFingerprint(size, trailer, exehash, exe_sample(exe, size));
+}
+
+PackageInfo::PackageInfo() : hash(0), type(PACKAGE_NONE), output(NO_OUTPUT){
+
+}
+
+const PackageFirmware *PackageInfo::outputFirmware() const {
+    return output < firmwares.size() ? &firmwares[output] : nullptr;
+}
+
+const char *PackageInfo::typeName(PackType type){
+    const PackageFormat *fmt = findPackageFormat(type);
+    return fmt ? fmt->name : "none";
+}
+
 UpdatePackage::UpdatePackage(){
 
 }
 
+// Format of a known updater, or the format probed from an unknown one
+static const PackageFormat *exe_format(zu64 exehash, const zbyte *exe, zu64 size){
+    if(packages.contains(exehash)){
+        const PackType type = packages[exehash];
+        const PackageFormat *fmt = findPackageFormat(type);
+        if(!fmt)
+            ELOG("No package format for " << PackageInfo::typeName(type));
+        return fmt;
+    }
+    // try each format against the strings section
+    const PackageFormat *fmt = PackageScanner::probe(exe, size);
+    if(!fmt){
+        ELOG("Unknown updater executable: " << ZString::ItoS(exehash, 16));
+        return nullptr;
+    }
+    ELOG("Unknown updater executable: " << ZString::ItoS(exehash, 16) << ", looks like " << fmt->name);
+    return fmt;
+}
+
 bool UpdatePackage::loadFromExe(ZPath exe, int index){
-    LOG("Extract from " << exe);
-    ZFile file;
-    if(!file.open(exe, ZFile::READ)){
+    DLOG("Extract from " << exe);
+    info = PackageInfo();
+
+    MappedFile file;
+    if(!file.open(exe)){
         ELOG("Failed to open file");
         return false;
     }
 
-    zu64 exehash = ZFile::fileHash(exe);
-    if(packages.contains(exehash)){
-        int ret = types[packages[exehash]](&file, firmware);
-        return !ret;
-    } else {
-        ELOG("Unknown updater executable: " << ZString::ItoS(exehash, 16));
+    // output is derived from the content, so always confirm with the full hash
+    zu64 exehash = exe_hash(file);
+    if(DecodeCache::global().load(exehash, info))
+        return true;
+    add_fingerprint(exehash, file.data(), file.size());
+
+    info.hash = exehash;
+    const PackageFormat *fmt = exe_format(exehash, file.data(), file.size());
+    if(!fmt)
         return false;
-    }
+    info.type = fmt->type;
 
+    int ret = decode_package(*fmt, file.data(), file.size(), strings, info);
+    if(ret)
+        return false;
+    DecodeCache::global().store(info);
     return true;
 }
 
 const ZBinary &UpdatePackage::getFirmware() const {
-    return firmware;
+    static const ZBinary empty;
+    const PackageFirmware *fw = info.outputFirmware();
+    return fw ? fw->firmware : empty;
+}
+
+void UpdatePackage::printInfo() const {
+    LOG("Type:        " << PackageInfo::typeName(info.type));
+    LOG("Hash:        " << ZString::ItoS(info.hash, 16));
+    if(!info.description.isEmpty())
+        LOG("Description: " << info.description);
+    LOG("Company:     " << info.company);
+    LOG("Product:     " << info.product);
+    LOG("Version:     " << info.version);
+    LOG("Signature:   " << info.signature);
+    for(zu64 i = 0; i < info.firmwares.size(); ++i){
+        const PackageFirmware &fw = info.firmwares[i];
+        LOG("==============================");
+        LOG("Firmware " << i << ":  " << fw.firmware.size() << (i == info.output ? " (output)" : ""));
+        if(!fw.description.isEmpty())
+            LOG("Description: " << fw.description);
+        if(!fw.version.isEmpty())
+            LOG("Version:     " << fw.version);
+        for(zu64 j = 0; j < fw.layouts.size(); ++j)
+            LOG("Layout:      " << fw.layouts[j]);
+        if(fw.info.size() == 180){
+            ProtoCYKB::info_section(fw.info);
+        } else if(fw.info.size()){
+            LOG("Info:        " << fw.info.size());
+        }
+    }
+}
+
+PackType UpdatePackage::identify(ZPath exe, zu64 &hash){
+    hash = 0;
+    MappedFile file;
+    if(!file.open(exe)){
+        ELOG("Failed to read " << exe);
+        return PACKAGE_NONE;
+    }
+    const zu64 size = file.size();
+    const zu64 trailer = exe_trailer(file.data(), size);
+
+    zu64 sample = 0;
+    bool found = false;
+    const PackageFingerprint *known = find_known_fingerprint(size, trailer);
+    if(known){
+        hash = known->hash;
+        sample = known->sample;
+        found = true;
+    } else {
+        found = DecodeCache::global().findFingerprint(size, trailer, hash, sample);
+        if(!found && fingerprints_complete()){
+            // not a known updater, no need for the full hash
+            hash = 0;
+            return PACKAGE_NONE;
+        }
+    }
+    if(found){
+        // a candidate only, until the sampled blocks match too
+        if(exe_sample(file.data(), size) == sample)
+            return packages.contains(hash) ? packages[hash] : PACKAGE_NONE;
+        DLOG("Fingerprint mismatch: " << exe);
+    }
+
+    hash = exe_hash(file);
+    add_fingerprint(hash, file.data(), size);
+    return packages.contains(hash) ? packages[hash] : PACKAGE_NONE;
+}
+
+PackType UpdatePackage::fingerprint(ZPath exe, PackageFingerprint &fp){
+    fp = PackageFingerprint();
+    MappedFile file;
+    if(!file.open(exe)){
+        ELOG("Failed to read " << exe);
+        return PACKAGE_NONE;
+    }
+    fp.size = file.size();
+    fp.trailer = exe_trailer(file.data(), fp.size);
+    fp.sample = exe_sample(file.data(), fp.size);
+    fp.hash = exe_hash(file);
+    return packages.contains(fp.hash) ? packages[fp.hash] : PACKAGE_NONE;
+}
+
+bool UpdatePackage::writeAll(ZPath prefix) const {
+    for(zu64 i = 0; i < info.firmwares.size(); ++i){
+        const PackageFirmware &fw = info.firmwares[i];
+        if(fw.firmware.size()){
+            ZPath out = prefix.str() + "." + ZString::ItoS(i) + ".bin";
+            LOG("Write " << out);
+            if(!ZFile::writeBinary(out, fw.firmware)){
+                ELOG("Write Error: " << out);
+                return false;
+            }
+        }
+        if(fw.info.size()){
+            ZPath out = prefix.str() + "." + ZString::ItoS(i) + ".info";
+            LOG("Write " << out);
+            if(!ZFile::writeBinary(out, fw.info)){
+                ELOG("Write Error: " << out);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Summary of one decoded updater, firmware is not kept after it is written
+struct DecodeResult {
+    bool ok;
+    zu64 hash;
+    PackType type;
+    ZString version;
+    ZString layouts;
+    ZString sizes;
+};
+
+struct DecodeWork {
+    const ZArray<ZPath> *files;
+    ZPath outdir;
+    std::atomic<zu64> next;
+    std::vector<DecodeResult> results;
+};
+
+// Each worker takes the next updater and decodes with its own buffers
+static void *decode_worker(ZThread::ZThreadArg zarg){
+    DecodeWork *work = (DecodeWork *)zarg.arg;
+    const ZArray<ZPath> &files = *work->files;
+    UpdatePackage package;
+    for(zu64 i = work->next++; i < files.size(); i = work->next++){
+        DecodeResult &result = work->results[i];
+        result.ok = package.loadFromExe(files[i], 0);
+        if(result.ok){
+            ZPath out = work->outdir + ZPath(files[i].last() + ".bin");
+            if(!ZFile::writeBinary(out, package.getFirmware())){
+                ELOG("Write Error: " << out);
+                result.ok = false;
+            }
+        }
+        const PackageInfo &info = package.getInfo();
+        result.hash = info.hash;
+        result.type = info.type;
+        result.version = info.version;
+        for(zu64 j = 0; j < info.firmwares.size(); ++j){
+            const PackageFirmware &fw = info.firmwares[j];
+            for(zu64 k = 0; k < fw.layouts.size(); ++k){
+                if(!result.layouts.isEmpty())
+                    result.layouts += ",";
+                result.layouts += fw.layouts[k];
+            }
+            if(j)
+                result.sizes += ",";
+            result.sizes += ZString::ItoS(fw.firmware.size());
+        }
+    }
+    return nullptr;
+}
+
+bool UpdatePackage::decodeDirectory(ZPath dir, ZPath outdir, unsigned threads){
+    ZArray<ZPath> files;
+    if(!listFiles(dir, files, ".exe"))
+        return false;
+    if(!makeDirs(outdir)){
+        ELOG("Unable to create " << outdir);
+        return false;
+    }
+
+    if(!threads)
+        threads = std::thread::hardware_concurrency();
+    if(!threads)
+        threads = 1;
+    if(threads > files.size())
+        threads = files.size() ? files.size() : 1;
+
+    DecodeWork work;
+    work.files = &files;
+    work.outdir = outdir;
+    work.next = 0;
+    work.results.resize(files.size());
+
+    // workers that did start still take every updater
+    std::vector<ZThread> workers(threads);
+    unsigned started = 0;
+    while(started < threads && workers[started].run(decode_worker, &work))
+        started++;
+    for(unsigned t = 0; t < started; ++t)
+        workers[t].join();
+    if(!started){
+        ELOG("Failed to start workers");
+        return false;
+    }
+    const std::vector<DecodeResult> &results = work.results;
+
+    // report in file order
+    zu64 failed = 0;
+    for(zu64 i = 0; i < files.size(); ++i){
+        const DecodeResult &result = results[i];
+        if(!result.ok)
+            failed++;
+        LOG(files[i].last() << "\t" << (result.ok ? "ok" : "FAILED") << "\t" <<
+            ZString::ItoS(result.hash, 16) << "\t" << PackageInfo::typeName(result.type) << "\t" <<
+            result.version << "\t" << result.layouts << "\t" << result.sizes);
+    }
+    LOG("Decoded " << (files.size() - failed) << "/" << files.size() << " updaters");
+    return failed == 0;
 }
 
 /*  Decode the encryption scheme used by the updater program.
@@ -128,498 +530,632 @@ const ZBinary &UpdatePackage::getFirmware() const {
  *  First, swap the 1st and 4th bytes, every 5 bytes
  *  Second, reverse each pair of bytes
  *  Third, shift the bits in each byte, sub 7 from MSBs
+ *  Reference implementation, one pass per step.
  */
-void decode_package_data(ZBinary &bin){
+void decode_package_data_ref(zbyte *data, zu64 size){
     // Swap bytes 4 apart, skip 5
-    for(zu64 i = 4; i < bin.size(); i+=5){
-        zbyte a = bin[i-4];
-        zbyte b = bin[i];
-        bin[i-4] = b;
-        bin[i] = a;
+    for(zu64 i = 4; i < size; i+=5){
+        zbyte a = data[i-4];
+        zbyte b = data[i];
+        data[i-4] = b;
+        data[i] = a;
     }
 
     // Swap bytes in each set of two bytes
-    for(zu64 i = 1; i < bin.size(); i+=2){
-        zbyte d = bin[i-1];
-        zbyte b = bin[i];
-        bin[i-1] = b;
-        bin[i] = d;
+    for(zu64 i = 1; i < size; i+=2){
+        zbyte d = data[i-1];
+        zbyte b = data[i];
+        data[i-1] = b;
+        data[i] = d;
     }
 
     // y = ((x - 7) << 4) + (x >> 4)
-    for(zu64 i = 0; i < bin.size(); ++i){
-        bin[i] = (((bin[i] - 7) << 4) + (bin[i] >> 4)) & 0xFF;
+    for(zu64 i = 0; i < size; ++i){
+        data[i] = (((data[i] - 7) << 4) + (data[i] >> 4)) & 0xFF;
     }
 }
 
 /*  Encrypt using the encryption scheme used by the updater program
  *   Reverse engineered from the above
+ *  Reference implementation, one pass per step.
  */
-void encode_package_data(ZBinary &bin){
+void encode_package_data_ref(zbyte *data, zu64 size){
     // x = (y >> 4 + 7 & 0xF) | (x << 4)
-    for(zu64 i = 0; i < bin.size(); ++i){
-        bin[i] = ((((bin[i] >> 4) + 7) & 0xF) | (bin[i] << 4)) & 0xFF;
+    for(zu64 i = 0; i < size; ++i){
+        data[i] = ((((data[i] >> 4) + 7) & 0xF) | (data[i] << 4)) & 0xFF;
     }
 
     // Swap bytes in each set of two bytes
-    for(zu64 i = 1; i < bin.size(); i+=2){
-        zbyte d = bin[i-1];
-        zbyte b = bin[i];
-        bin[i-1] = b;
-        bin[i] = d;
+    for(zu64 i = 1; i < size; i+=2){
+        zbyte d = data[i-1];
+        zbyte b = data[i];
+        data[i-1] = b;
+        data[i] = d;
     }
 
     // Swap bytes 4 apart, skip 5
-    for(zu64 i = 4; i < bin.size(); i+=5){
-        zbyte a = bin[i-4];
-        zbyte b = bin[i];
-        bin[i-4] = b;
-        bin[i] = a;
+    for(zu64 i = 4; i < size; i+=5){
+        zbyte a = data[i-4];
+        zbyte b = data[i];
+        data[i-4] = b;
+        data[i] = a;
     }
 }
 
-ZBinary pkg_file_read(ZFile *file, zu64 pos, zu64 len){
-    ZBinary data;
-    if(file->seek(pos) != pos)
-        throw ZException("File too short - seek");
-    if(file->read(data, len) != len)
-        throw ZException("File too short - read");
-    return data;
+static inline zbyte decode_nibbles(zbyte x){
+    return (((x - 7) << 4) | (x >> 4)) & 0xFF;
 }
 
-/*  Decode the updater for the POK3R.
- */
-int decode_maajonsn(ZFile *file, ZBinary &fw_out){
-    zu64 exelen = file->fileSize();
+static inline zbyte encode_nibbles(zbyte y){
+    return ((((y >> 4) + 7) & 0xF) | (y << 4)) & 0xFF;
+}
 
-    zu64 strings_len = 0x4B8;
+/*  Both swaps repeat every 10 bytes, and the nibble step is per byte, so the
+ *  whole transform is a fixed 10 byte shuffle followed by the nibble step.
+ *  Output byte k of a group comes from input byte perm[k].
+ */
+static const zu8 decode_perm[10] = { 1, 4, 3, 2, 9, 0, 7, 6, 5, 8 };
+static const zu8 encode_perm[10] = { 5, 0, 3, 2, 1, 8, 7, 6, 9, 4 };
 
-    zu64 offset_company = 0x10;
-    zu64 offset_product = offset_company + 0x208; // 0x218
-    zu64 offset_version = 0x460;
-    zu64 offset_sig = 0x4AE;
+#ifdef __SSE2__
 
-    zu64 strings_start = exelen - strings_len;
+/*  80 bytes (16 groups of 5, 5 vectors of 16) are swapped and transformed while
+ *  they are in cache. The 5 stride swap is scalar, the pair swap and nibble
+ *  step use SSE2.
+ */
+#define PKG_BLOCK 80
 
-    // Read strings
-    ZBinary strs = pkg_file_read(file, strings_start, strings_len);
-    // Decrypt strings
-    decode_package_data(strs);
+static inline void swap_stride5(zbyte *data){
+    for(int i = 0; i < PKG_BLOCK; i += 5){
+        zbyte a = data[i];
+        data[i] = data[i + 4];
+        data[i + 4] = a;
+    }
+}
 
-    ZString company;
-    ZString product;
-    ZString version;
+static void decode_block(zbyte *data){
+    swap_stride5(data);
+    const __m128i low = _mm_set1_epi8(0x0F);
+    const __m128i seven = _mm_set1_epi8(7);
+    for(int i = 0; i < PKG_BLOCK; i += 16){
+        __m128i x = _mm_loadu_si128((const __m128i *)(data + i));
+        // pair swap
+        x = _mm_or_si128(_mm_slli_epi16(x, 8), _mm_srli_epi16(x, 8));
+        // ((x - 7) << 4) | (x >> 4)
+        __m128i hi = _mm_slli_epi16(_mm_and_si128(_mm_sub_epi8(x, seven), low), 4);
+        __m128i lo = _mm_and_si128(_mm_srli_epi16(x, 4), low);
+        _mm_storeu_si128((__m128i *)(data + i), _mm_or_si128(hi, lo));
+    }
+}
 
-    // Company name
-    company.parseUTF16((const zu16 *)(strs.raw() + offset_company), 0x200);
-    // Product name
-    product.parseUTF16((const zu16 *)(strs.raw() + offset_product), 0x200);
-    // Version
-    version = ZString(strs.raw() + offset_version, 12);
+static void encode_block(zbyte *data){
+    const __m128i low = _mm_set1_epi8(0x0F);
+    const __m128i seven = _mm_set1_epi8(7);
+    for(int i = 0; i < PKG_BLOCK; i += 16){
+        __m128i y = _mm_loadu_si128((const __m128i *)(data + i));
+        // (((y >> 4) + 7) & 0xF) | (y << 4)
+        __m128i lo = _mm_and_si128(_mm_add_epi8(_mm_and_si128(_mm_srli_epi16(y, 4), low), seven), low);
+        __m128i hi = _mm_slli_epi16(_mm_and_si128(y, low), 4);
+        __m128i x = _mm_or_si128(hi, lo);
+        // pair swap
+        x = _mm_or_si128(_mm_slli_epi16(x, 8), _mm_srli_epi16(x, 8));
+        _mm_storeu_si128((__m128i *)(data + i), x);
+    }
+    swap_stride5(data);
+}
 
-    LOG("Company:     " << company);
-    LOG("Product:     " << product);
-    LOG("Version:     " << version);
+#endif
 
-    LOG("Signature:   " << ZString(strs.raw() + offset_sig, strings_len - offset_sig));
+/*  Decode the updater encryption in a single pass.
+ *  Same result as decode_package_data_ref().
+ */
+void decode_package_data(zbyte *data, zu64 size){
+    zu64 i = 0;
+#ifdef __SSE2__
+    for(; i + PKG_BLOCK <= size; i += PKG_BLOCK)
+        decode_block(data + i);
+#endif
+    for(; i + 10 <= size; i += 10){
+        zbyte in[10];
+        memcpy(in, data + i, 10);
+        for(int k = 0; k < 10; ++k)
+            data[i + k] = decode_nibbles(in[decode_perm[k]]);
+    }
+    // groups start on a multiple of 10, so the tail swaps the same way
+    decode_package_data_ref(data + i, size - i);
+}
 
-//    LOG("String Dump:");
-//    RLOG(strs.dumpBytes(4, 8));
+/*  Encode the updater encryption in a single pass.
+ *  Same result as encode_package_data_ref().
+ */
+void encode_package_data(zbyte *data, zu64 size){
+    zu64 i = 0;
+#ifdef __SSE2__
+    for(; i + PKG_BLOCK <= size; i += PKG_BLOCK)
+        encode_block(data + i);
+#endif
+    for(; i + 10 <= size; i += 10){
+        zbyte in[10];
+        memcpy(in, data + i, 10);
+        for(int k = 0; k < 10; ++k)
+            data[i + k] = encode_nibbles(in[encode_perm[k]]);
+    }
+    encode_package_data_ref(data + i, size - i);
+}
 
-    // Decode other encrypted sections
+void decode_package_data(ZBinary &bin){
+    decode_package_data(bin.raw(), bin.size());
+}
 
-    zu64 total = strings_len;
-    ZArray<zu64> sections;
+void encode_package_data(ZBinary &bin){
+    encode_package_data(bin.raw(), bin.size());
+}
 
-    zu64 sec_len = ZBinary::decleu32(strs.raw() + 0x420); // Firmware length
+/*  Reference KBP cipher, one byte at a time.
+ */
+static void kbp_decrypt_ref(zbyte *data, zu64 size, zu32 key){
+    zbyte xor_key[4];
+    ZBinary::encbeu32(xor_key, key);
+    for(zu64 i = 0; i < size; ++i){
+        data[i] = data[i] ^ xor_key[i % 4] ^ (i & 0xFF);
+    }
+}
 
-    ZString layout;
-    layout.parseUTF16((const zu16 *)(strs.raw() + 0x424), 0x20);
-    LOG("Layout: " << layout);
+void kbp_keystream(zu32 key, zbyte *stream){
+    zbyte xor_key[4];
+    ZBinary::encbeu32(xor_key, key);
+    for(zu32 i = 0; i < KBP_STREAM_LEN; ++i)
+        stream[i] = xor_key[i % 4] ^ (i & 0xFF);
+}
 
-    total += sec_len;
-    sections.push(sec_len);
+/*  XOR bytes \a start to \a end of a section with the keystream.
+ *  The keystream is indexed by section offset, so any range can be done separately.
+ */
+static void kbp_xor(zbyte *data, zu64 start, zu64 end, const zbyte *stream){
+    zu64 i = start;
+#ifdef __SSE2__
+    for(; i + 16 <= end; i += 16){
+        __m128i x = _mm_loadu_si128((const __m128i *)(data + i));
+        __m128i k = _mm_loadu_si128((const __m128i *)(stream + (i & 0xFF)));
+        _mm_storeu_si128((__m128i *)(data + i), _mm_xor_si128(x, k));
+    }
+#else
+    for(; i + 8 <= end; i += 8){
+        zu64 x, k;
+        memcpy(&x, data + i, 8);
+        memcpy(&k, stream + (i & 0xFF), 8);
+        x ^= k;
+        memcpy(data + i, &x, 8);
+    }
+#endif
+    for(; i < end; ++i)
+        data[i] ^= stream[i & 0xFF];
+}
 
-    zu64 sec_start = exelen - total;
+/*  Same result as kbp_decrypt_ref().
+ */
+void kbp_decrypt(zbyte *data, zu64 size, zu32 key){
+    zbyte stream[KBP_STREAM_LEN];
+    kbp_keystream(key, stream);
+    kbp_xor(data, 0, size, stream);
+}
 
-    LOG("Offset: 0x" << ZString::ItoS(sec_start, 16));
-    LOG("Length: 0x" << ZString::ItoS(sec_len, 16));
+/*  Each packet under the POK3R firmware encryption is decoded right after it is
+ *  decrypted, while it is still in cache. A partial packet at the end of the firmware
+ *  is left as is, where ProtoPOK3R::decode_firmware() would read past the end.
+ */
+void kbp_decode_pok3r(zbyte *data, zu64 size, zu32 key){
+    zbyte stream[KBP_STREAM_LEN];
+    kbp_keystream(key, stream);
+    zu64 pos = 0;
+    for(zu32 num = ProtoPOK3R::FW_PACKET_FIRST; num <= ProtoPOK3R::FW_PACKET_LAST; ++num){
+        const zu64 start = (zu64)num * ProtoPOK3R::FW_PACKET_LEN;
+        const zu64 end = start + ProtoPOK3R::FW_PACKET_LEN;
+        if(end > size)
+            break;
+        kbp_xor(data, pos, end, stream);
+        ProtoPOK3R::decode_firmware_packet(data + start, num);
+        pos = end;
+    }
+    kbp_xor(data, pos, size, stream);
+}
 
-    // Read section
-    ZBinary sec = pkg_file_read(file, sec_start, sec_len);
-    // Decode section
-    decode_package_data(sec);
+bool UpdatePackage::benchmark(zu64 size, zu32 rounds){
+    typedef std::chrono::steady_clock clock;
+    ZBinary input(size);
+    zu32 seed = 0x12345678;
+    for(zu64 i = 0; i < size; ++i){
+        seed = seed * 1103515245 + 12345;
+        input[i] = (seed >> 16) & 0xFF;
+    }
 
-    // Decrypt firmware
-    ProtoPOK3R::decode_firmware(sec);
+    // check against the reference for every tail length
+    for(zu64 len = 0; len <= 2 * 80 + 10 && len <= size; ++len){
+        ZBinary a(input.raw(), len);
+        ZBinary b(input.raw(), len);
+        decode_package_data_ref(a.raw(), len);
+        decode_package_data(b.raw(), len);
+        if(a != b){
+            ELOG("decode mismatch at length " << len);
+            return false;
+        }
+        encode_package_data(b.raw(), len);
+        if(b != ZBinary(input.raw(), len)){
+            ELOG("encode mismatch at length " << len);
+            return false;
+        }
+    }
 
-//    LOG("Section Dump:");
-//    RLOG(sec.dumpBytes(4, 8, 0));
+    ZBinary ref = input;
+    ZBinary fused = input;
+    double ref_ms = 0, fused_ms = 0;
+    for(zu32 r = 0; r < rounds; ++r){
+        auto t0 = clock::now();
+        decode_package_data_ref(ref.raw(), size);
+        auto t1 = clock::now();
+        decode_package_data(fused.raw(), size);
+        auto t2 = clock::now();
+        ref_ms += std::chrono::duration<double, std::milli>(t1 - t0).count();
+        fused_ms += std::chrono::duration<double, std::milli>(t2 - t1).count();
+    }
+    if(ref != fused){
+        ELOG("decode mismatch");
+        return false;
+    }
 
-    // Write firmware
-    fw_out = sec;
+    // KBP cipher, for every keystream phase and tail length
+    const zu32 key = 0xDA6282CD;
+    for(zu64 len = 0; len <= KBP_STREAM_LEN + 16 && len <= size; ++len){
+        ZBinary a(input.raw(), len);
+        ZBinary b(input.raw(), len);
+        kbp_decrypt_ref(a.raw(), len, key);
+        kbp_decrypt(b.raw(), len, key);
+        if(a != b){
+            ELOG("kbp mismatch at length " << len);
+            return false;
+        }
+    }
+    // KBP with POK3R firmware, on whole packets through the last encrypted packet
+    const zu64 packets_end = (ProtoPOK3R::FW_PACKET_LAST + 1) * ProtoPOK3R::FW_PACKET_LEN;
+    for(zu64 len = 0; len <= packets_end + ProtoPOK3R::FW_PACKET_LEN && len <= size; len += ProtoPOK3R::FW_PACKET_LEN){
+        ZBinary a(input.raw(), len);
+        ZBinary b(input.raw(), len);
+        kbp_decrypt_ref(a.raw(), len, key);
+        ProtoPOK3R::decode_firmware(a);
+        kbp_decode_pok3r(b.raw(), len, key);
+        if(a != b){
+            ELOG("kbp pok3r mismatch at length " << len);
+            return false;
+        }
+    }
 
-    return 0;
+    ZBinary kbp_ref = input;
+    ZBinary kbp_fused = input;
+    double kbp_ref_ms = 0, kbp_fused_ms = 0;
+    for(zu32 r = 0; r < rounds; ++r){
+        auto t0 = clock::now();
+        kbp_decrypt_ref(kbp_ref.raw(), size, key);
+        if(size >= packets_end)
+            ProtoPOK3R::decode_firmware(kbp_ref);
+        auto t1 = clock::now();
+        if(size >= packets_end){
+            kbp_decode_pok3r(kbp_fused.raw(), size, key);
+        } else {
+            kbp_decrypt(kbp_fused.raw(), size, key);
+        }
+        auto t2 = clock::now();
+        kbp_ref_ms += std::chrono::duration<double, std::milli>(t1 - t0).count();
+        kbp_fused_ms += std::chrono::duration<double, std::milli>(t2 - t1).count();
+    }
+    if(kbp_ref != kbp_fused){
+        ELOG("kbp mismatch");
+        return false;
+    }
 
+    const double mb = (double)size * rounds / (1024 * 1024);
+    LOG("Size:      " << size << " x " << rounds);
+    LOG("Reference: " << ref_ms << " ms, " << (ref_ms > 0 ? mb / (ref_ms / 1000) : 0) << " MB/s");
+    LOG("Fused:     " << fused_ms << " ms, " << (fused_ms > 0 ? mb / (fused_ms / 1000) : 0) << " MB/s");
+    LOG("KBP Ref:   " << kbp_ref_ms << " ms, " << (kbp_ref_ms > 0 ? mb / (kbp_ref_ms / 1000) : 0) << " MB/s");
+    LOG("KBP Fused: " << kbp_fused_ms << " ms, " << (kbp_fused_ms > 0 ? mb / (kbp_fused_ms / 1000) : 0) << " MB/s");
+    return true;
 }
 
-/*  Decode the updater for the POK3R RGB / Vortex Core.
+/*  Copy a section of the mapped exe into \a out, reusing its storage.
  */
-int decode_maav102(ZFile *file, ZBinary &fw_out){
-    zu64 exelen = file->fileSize();
+bool pkg_slice(const zbyte *exe, zu64 exelen, zu64 pos, zu64 len, ZBinary &out){
+    if(pos > exelen || len > exelen - pos){
+        ELOG("File too short: 0x" << ZString::ItoS(pos, 16) << " + 0x" << ZString::ItoS(len, 16));
+        return false;
+    }
+    out.resize(len);
+    if(len)
+        memcpy(out.raw(), exe + pos, len);
+    return true;
+}
+
+static void pkg_decipher(const PackageFormat &fmt, PackCipher cipher, ZBinary &data){
+    switch(cipher){
+        case CIPHER_PACKAGE:
+            decode_package_data(data);
+            break;
+        case CIPHER_KBP:
+            kbp_decrypt(data.raw(), data.size(), fmt.key);
+            break;
+        default:
+            break;
+    }
+}
 
-    zu64 strings_len = 0xB24;   // from IDA disassembly in sub_403830 of v130 updater
-                                // same size in v104
-    zu64 strings_start = exelen - strings_len;
+static void pkg_encipher(const PackageFormat &fmt, PackCipher cipher, ZBinary &data){
+    switch(cipher){
+        case CIPHER_PACKAGE:
+            encode_package_data(data);
+            break;
+        case CIPHER_KBP:
+            kbp_decrypt(data.raw(), data.size(), fmt.key);
+            break;
+        default:
+            break;
+    }
+}
 
-    zu64 offset_desc = 0x26;
-    zu64 offset_company = offset_desc + 0x208;      // 0x22e
-    zu64 offset_product = offset_company + 0x208;   // 0x436
-    zu64 offset_version = offset_product + 0x208;   // 0x63e
-    zu64 offset_sig = 0xb19;
+/*  Decode an updater described by \a fmt.
+ *  The strings section is decoded into \a strs, and every field is read in place
+ *  from it. Each firmware and info section is then copied into its PackageFirmware
+ *  and decoded there.
+ */
+int decode_package(const PackageFormat &fmt, const zbyte *exe, zu64 exelen, ZBinary &strs, PackageInfo &info){
+    if(exelen < fmt.strings_len){
+        ELOG("File too short for strings");
+        return -1;
+    }
+    const zu64 strings_start = exelen - fmt.strings_len;
 
     // Read strings
-    ZBinary strs = pkg_file_read(file, strings_start, strings_len);
+    if(!pkg_slice(exe, exelen, strings_start, fmt.strings_len, strs))
+        return -1;
     // Decrypt strings
-    decode_package_data(strs);
-
-    ZString desc;
-    ZString company;
-    ZString product;
-    ZString version;
-
-    // Description
-    desc.parseUTF16((const zu16 *)(strs.raw() + offset_desc), 0x200);
-    // Company name
-    company.parseUTF16((const zu16 *)(strs.raw() + offset_company), 0x200);
-    // Product name
-    product.parseUTF16((const zu16 *)(strs.raw() + offset_product), 0x200);
-    // Version
-    version.parseUTF16((const zu16 *)(strs.raw() + offset_version), 0x200);
-
-    LOG("==============================");
-
-    LOG("Description: " << desc);
-    LOG("Company:     " << company);
-    LOG("Product:     " << product);
-    LOG("Version:     " << version);
-
-    LOG("Signature:   " << ZString(strs.raw() + offset_sig, strings_len - offset_sig));
+    pkg_decipher(fmt, fmt.strings_cipher, strs);
 
 //    LOG("String Dump:");
 //    RLOG(strs.dumpBytes(4, 8));
 
-    LOG("==============================");
-
-    // Decode other encrypted sections
-
-    zu64 total = strings_len;
-    ZArray<zu64> sections;
-
-    zu64 start = 0xAC8 - (0x50 * 8);
-    for(zu8 i = 0; i < 8; ++i){
-        zu32 fwl = ZBinary::decleu32(strs.raw() + start); // Firmware length
-        zu32 strl = ZBinary::decleu32(strs.raw() + start + 4); // Info length
-
-        if(fwl){
-            ZString layout;
-            layout.parseUTF16((const zu16 *)(strs.raw() + start + 8), 0x20);
-            LOG("Layout " << i << ": " << layout);
-
-            total += fwl;
-            total += strl;
-            sections.push(fwl);
-            sections.push(strl);
-        }
-        start += 0x50;
-    }
-
-    LOG("==============================");
+    const PackFields fields(strs.raw(), strs.size());
+    info.description = fields.str(fmt.description);
+    info.company = fields.str(fmt.company);
+    info.product = fields.str(fmt.product);
+    info.version = fields.str(fmt.version);
+    info.signature = fields.str(fmt.signature);
 
-    zu64 sec_start = exelen - total;
-    LOG("Section Count: " << sections.size());
+    ZArray<PackSection> sections;
+    int ret = package_layout(fmt, fields, strings_start, sections);
+    if(ret)
+        return ret;
 
+    // sized up front, each firmware is decoded in place in its own entry
+    info.firmwares.resize(sections.size());
     for(zu64 i = 0; i < sections.size(); ++i){
-        zu64 sec_len = sections[i];
-        if(sec_len == 0)
-            continue;
-
-        LOG("Section " << i << ":");
-//        LOG("  Offset: 0x" << ZString::ItoS(sec_start, 16));
-        LOG("  Length: " << sec_len);
-
-        // Read section
-        ZBinary sec = pkg_file_read(file, sec_start, sec_len);
-        sec_start += sec_len;
+        PackageFirmware &fw = info.firmwares[i];
+        const PackSection &sec = sections[i];
+        const zu64 entry = sec.entry;
+
+        fw.description = fields.str(fmt.fw_description, entry);
+        fw.version = fields.str(fmt.fw_version, entry);
+        for(zu32 j = 0; j < fmt.layout_count; ++j){
+            const zu64 pos = entry + fmt.layout.offset + (zu64)fmt.layout_stride * j;
+            if(!fields.u8(pos))
+                break;
+            fw.layouts.push(fields.str(fmt.layout, pos - fmt.layout.offset));
+        }
 
-        // Decode section
-        decode_package_data(sec);
+        DLOG("Firmware " << i << ": " << sec.firmware_len << " + " << sec.info_len);
 
-        // Decrypt RGB firmwares only
-        if(sec.size() == 180){
-            LOG("  Data");
-            RLOG(sec.dumpBytes(4, 8, 0));
-            ProtoCYKB::info_section(sec);
-            continue;
+        // Read firmware
+        if(!pkg_slice(exe, exelen, sec.firmware_pos, sec.firmware_len, fw.firmware))
+            return -3;
+        // Decrypt firmware
+        if(fmt.section_cipher == CIPHER_KBP && fmt.firmware == FIRMWARE_POK3R){
+            kbp_decode_pok3r(fw.firmware.raw(), fw.firmware.size(), fmt.key);
         } else {
-            LOG("  Firmware" << ZLog::NOLN);
-            ProtoCYKB::decode_firmware(sec);
-            if(i == 0){
-                fw_out = sec;
-                RLOG(" (output)");
+            pkg_decipher(fmt, fmt.section_cipher, fw.firmware);
+            switch(fmt.firmware){
+                case FIRMWARE_POK3R:
+                    ProtoPOK3R::decode_firmware(fw.firmware);
+                    break;
+                case FIRMWARE_CYKB:
+                    ProtoCYKB::decode_firmware(fw.firmware);
+                    break;
+                default:
+                    break;
             }
-            RLOG(ZLog::NEWLN);
         }
+
+        // Read info
+        if(!pkg_slice(exe, exelen, sec.info_pos, sec.info_len, fw.info))
+            return -4;
+        // Decrypt info
+        pkg_decipher(fmt, fmt.section_cipher, fw.info);
+        if(fw.info.size())
+            DLOG(fw.info.dumpBytes(4, 8, 0));
+
     }
+    info.output = package_output(fmt, sections);
 
     return 0;
 }
 
-int decode_maav105(ZFile *file, ZBinary &fw_out){
-    zu64 exelen = file->fileSize();
-    zu64 strings_len = 0x2b58;   // from decompiled FUN_4049d0 of TAB_75_V100
-    zu64 strings_start = exelen - strings_len;
-
-//    zu64 offset_desc = 0x23de - 180;
-    zu64 offset_desc = 0x232a;
-    zu64 offset_company = offset_desc + 0x208;
-    zu64 offset_product = offset_company + 0x208;
-    zu64 offset_version = offset_product + 0x208;
-    zu64 offset_sig = exelen - strings_start - 13;
-
-    // Read strings
-    ZBinary strs = pkg_file_read(file, strings_start, exelen - strings_start);
-    // Decrypt strings
-    decode_package_data(strs);
-
-//    zu64 pos = 0x0;
-//    for(int i = 0; i < 20; ++i){
-//        zu32 d = ZBinary::decleu32(strs.raw() + pos); // Firmware length
-//        LOG(ZString::ItoS((zu64)d, 16));
-//        pos += 4;
-//    }
-
-    RLOG(strs.dumpBytes(4, 8));
-    ZFile::writeBinary("manifest.bin", strs);
-
-    ZString pkgdesc;
-    ZString company;
-    ZString product;
-    ZString pkgver;
-
-    // Description
-    pkgdesc.parseUTF16((const zu16 *)(strs.raw() + offset_desc), 0x200);
-    // Company name
-    company.parseUTF16((const zu16 *)(strs.raw() + offset_company), 0x200);
-    // Product name
-    product.parseUTF16((const zu16 *)(strs.raw() + offset_product), 0x200);
-    // Version
-    pkgver.parseUTF16((const zu16 *)(strs.raw() + offset_version), 0x200);
-
-    LOG("==============================");
-    LOG("Description: " << pkgdesc);
-    LOG("Company:     " << company);
-    LOG("Product:     " << product);
-    LOG("Version:     " << pkgver);
-    LOG("Signature:   " << ZString(strs.raw() + offset_sig, 13));
-
-    zu64 section_start = 0x1F1600;
-
-    zu64 list_pos = 0xc8;
-    for(int i = 0; i < 4; ++i){
-        zu64 desc_start = list_pos;
-        zu64 version_start = desc_start + 0x208;
-        zu64 addr_pos = version_start + 0x208;
-        zu64 layout_start = addr_pos + 8;
-
-        LOG("==============================");
+/*  Find each firmware entry in the decoded strings section, and where its
+ *  sections are in the exe.
+ */
+int package_layout(const PackageFormat &fmt, const PackFields &fields, zu64 strings_start, ZArray<PackSection> &sections){
+    zu64 total = 0;
+    for(zu32 i = 0; i < fmt.entry_count; ++i){
+        PackSection sec;
+        sec.entry = fmt.table_offset + (zu64)fmt.entry_stride * i;
+        sec.firmware_len = fields.u32(sec.entry + fmt.firmware_len);
+        sec.info_len = fmt.info_len != PACK_NONE ? fields.u32(sec.entry + fmt.info_len) : 0;
+        if(fmt.skip_empty && !sec.firmware_len)
+            continue;
+        sections.push(sec);
+        total += (zu64)sec.firmware_len + sec.info_len;
+    }
 
-        // Product name
-        ZString desc;
-        desc.parseUTF16((const zu16 *)(strs.raw() + desc_start), 0x200);
-        // Version
-        ZString version;
-        version.parseUTF16((const zu16 *)(strs.raw() + version_start), 0x200);
-
-        LOG("Description: " << desc);
-        LOG("Version:     " << version);
-
-        list_pos = layout_start + 0x2c8;
-
-        while(strs[layout_start]){
-            // Layout
-            ZString layout;
-            layout.parseUTF16((const zu16 *)(strs.raw() + layout_start), 0x200);
-            zu16 a1 = ZBinary::decleu16(strs.raw() + layout_start + 60);
-            zu16 a2 = ZBinary::decleu16(strs.raw() + layout_start + 62);
-            zu16 a3 = ZBinary::decleu16(strs.raw() + layout_start + 64);
-            LOG("Layout:      " << layout << " " << a1 << " " << a2 << " " << a3);
-            layout_start += 80;
+    zu64 sec_start;
+    if(fmt.sections == SECTIONS_BEFORE_STRINGS){
+        if(total > strings_start){
+            ELOG("File too short for sections");
+            return -2;
         }
-
-        zu32 fwl = ZBinary::decleu32(strs.raw() + addr_pos); // Firmware length
-        zu32 strl = ZBinary::decleu32(strs.raw() + addr_pos + 4); // Info length
-
-        // Read firmware
-        ZBinary fw = pkg_file_read(file, section_start, fwl);
-        section_start += fwl;
-        // Decrypt firmware
-        decode_package_data(fw);
-        ProtoCYKB::decode_firmware(fw);
-
-        // Read info
-        ZBinary info = pkg_file_read(file, section_start, strl);
-        section_start += strl;
-        // Decrypt info
-        decode_package_data(info);
-
-        if(fw.size())
-            fw_out = fw;
-
-        LOG("Firmware:    " << fwl);
-//        RLOG(fw.dumpBytes(4, 8));
-        LOG("Info:        " << strl);
-        if(info.size())
-            RLOG(info.dumpBytes(4, 8));
-
+        sec_start = strings_start - total;
+    } else {
+        sec_start = fmt.sections_offset;
     }
+    DLOG("Sections: " << sections.size() << " at 0x" << ZString::ItoS(sec_start, 16));
 
+    for(zu64 i = 0; i < sections.size(); ++i){
+        sections[i].firmware_pos = sec_start;
+        sec_start += sections[i].firmware_len;
+        sections[i].info_pos = sec_start;
+        sec_start += sections[i].info_len;
+    }
     return 0;
 }
 
-void kbp_decrypt(zbyte *data, zu64 size, zu32 key){
-    zbyte xor_key[4];
-    ZBinary::encbeu32(xor_key, key);
-    for(zu64 i = 0; i < size; ++i){
-        data[i] = data[i] ^ xor_key[i % 4] ^ (i & 0xFF);
+//! Index of the firmware written by a plain decode, PackageInfo::NO_OUTPUT if none.
+zu64 package_output(const PackageFormat &fmt, const ZArray<PackSection> &sections){
+    zu64 output = PackageInfo::NO_OUTPUT;
+    for(zu64 i = 0; i < sections.size(); ++i){
+        if(sections[i].firmware_len && (output == PackageInfo::NO_OUTPUT || fmt.output_last))
+            output = i;
     }
+    return output;
 }
 
-/*  Decode the updater for the KBP V60 / V80.
+/*  Replace one firmware section of an updater described by \a fmt with \a fw.
+ *  The firmware length in the strings section is updated, so the new firmware may
+ *  be any length. Everything outside the firmware and strings sections is written
+ *  to \a out straight from the mapped exe.
  */
-int decode_kbp_cykb(ZFile *file, ZBinary &fw_out, zu32 key){
-    zu64 exelen = file->fileSize();
-    zu64 strings_len = 588;
-    zu64 strings_start = exelen - strings_len;
+int repack_package(const PackageFormat &fmt, const zbyte *exe, zu64 exelen, zu64 index, ZBinary &fw, ZPath out){
+    if(exelen < fmt.strings_len){
+        ELOG("File too short for strings");
+        return -1;
+    }
+    const zu64 strings_start = exelen - fmt.strings_len;
 
-    // Read strings
     ZBinary strs;
-    if(file->seek(strings_start) != strings_start){
-        LOG("File too short - seek");
-        return -4;
+    if(!pkg_slice(exe, exelen, strings_start, fmt.strings_len, strs))
+        return -1;
+    pkg_decipher(fmt, fmt.strings_cipher, strs);
+
+    ZArray<PackSection> sections;
+    int ret = package_layout(fmt, PackFields(strs.raw(), strs.size()), strings_start, sections);
+    if(ret)
+        return ret;
+    if(index == PackageInfo::NO_OUTPUT)
+        index = package_output(fmt, sections);
+    if(index >= sections.size()){
+        ELOG("No firmware " << index << " in " << fmt.name << " updater");
+        return -5;
     }
-    if(file->read(strs, strings_len) != strings_len){
-        LOG("File too short - read");
+    const PackSection &sec = sections[index];
+    const zu64 length_pos = sec.entry + fmt.firmware_len;
+    const zu64 fw_end = sec.firmware_pos + sec.firmware_len;
+    if(length_pos + 4 > strs.size() || fw_end > strings_start){
+        ELOG("Bad firmware entry " << index);
         return -5;
     }
+    LOG("Replace firmware " << index << " at 0x" << ZString::ItoS(sec.firmware_pos, 16) <<
+        ": " << sec.firmware_len << " -> " << fw.size());
 
-    // Decrypt strings
-    kbp_decrypt(strs.raw(), strs.size(), key);
-
-    LOG("String Dump:");
-    RLOG(strs.dumpBytes(4, 8));
-
-    zu64 fw_start = 0x54000;
-    zu64 fw_len = ZBinary::decleu32(strs.raw() + 4);
+    // Encode firmware
+    switch(fmt.firmware){
+        case FIRMWARE_POK3R:
+            ProtoPOK3R::encode_firmware(fw);
+            break;
+        case FIRMWARE_CYKB:
+            ProtoCYKB::encode_firmware(fw);
+            break;
+        default:
+            break;
+    }
+    pkg_encipher(fmt, fmt.section_cipher, fw);
 
-    LOG("Firmware Size 0x" << ZString::ItoS(fw_len, 16));
+    // Update the firmware length and encode strings
+    ZBinary::encleu32(strs.raw() + length_pos, fw.size());
+    pkg_encipher(fmt, fmt.strings_cipher, strs);
 
-    // Read firmware
-    ZBinary fw;
-    if(file->seek(fw_start) != fw_start){
-        LOG("File too short - seek");
-        return -2;
+    ZFile file;
+    if(!file.open(out, ZFile::WRITE)){
+        ELOG("Failed to open " << out);
+        return -6;
     }
-    if(file->read(fw, fw_len) != fw_len){
-        LOG("File too short - read");
-        return -3;
+    // exe up to the firmware, new firmware, exe up to the strings, new strings
+    const zu64 mid = strings_start - fw_end;
+    if(file.write(exe, sec.firmware_pos) != sec.firmware_pos ||
+            file.write(fw) != fw.size() ||
+            file.write(exe + fw_end, mid) != mid ||
+            file.write(strs) != strs.size()){
+        ELOG("Write error: " << out);
+        return -7;
     }
-
-    // Decrypt firmware
-    kbp_decrypt(fw.raw(), fw.size(), key);
-    ProtoPOK3R::decode_firmware(fw);
-    fw_out = fw;
-
-    //RLOG(fw_out.dumpBytes(4, 8));
-
     return 0;
 }
 
-int decode_kbp_v60(ZFile *file, ZBinary &fw_out){
-    zu32 key = 0xDA6282CD;  // v60
-    return decode_kbp_cykb(file, fw_out, key);
-}
-
-int decode_kbp_v80(ZFile *file, ZBinary &fw_out){
-    zu32 key = 0xF6F3111F;  // v80
-    return decode_kbp_cykb(file, fw_out, key);
-}
-
-int encode_image(ZPath fwin, ZPath fwout){
-    LOG("Input: " << fwin);
-
-    // Read firmware
-    ZBinary fwbin;
-    if(!ZFile::readBinary(fwin, fwbin)){
-        LOG("Failed to read file");
-        return -1;
+// Decode the updater at \a path with \a fmt, and compare firmware \a index with \a fw
+static bool check_repack(const PackageFormat &fmt, ZPath path, zu64 index, const ZBinary &fw){
+    MappedFile file;
+    if(!file.open(path)){
+        ELOG("Failed to open " << path);
+        return false;
     }
-
-//    Pok3r::encode_firmware(fwbin);
-    ProtoCYKB::encode_firmware(fwbin);
-    encode_package_data(fwbin);
-
-    LOG("Output: " << fwout);
-
-    // Write encoded image
-    if(!ZFile::writeBinary(fwout, fwbin)){
-        ELOG("Failed to write file");
-        return -2;
+    ZBinary strs;
+    PackageInfo info;
+    if(decode_package(fmt, file.data(), file.size(), strs, info)){
+        ELOG("Check Error: " << path);
+        return false;
     }
-
-    return 0;
+    const zu64 check = index == PackageInfo::NO_OUTPUT ? info.output : index;
+    if(check >= info.firmwares.size() || info.firmwares[check].firmware != fw){
+        ELOG("Check Error: firmware " << check << " does not match");
+        return false;
+    }
+    return true;
 }
 
-int encode_patch_updater(ZPath exein, ZPath fwin, ZPath exeout){
-    LOG("In Updater: " << exein);
-    LOG("In Firmware: " << fwin);
-
-    // Read updater
-    ZBinary exebin;
-    if(!ZFile::readBinary(exein, exebin)){
-        ELOG("Failed to read file");
-        return -1;
+bool UpdatePackage::repack(ZPath exe, ZPath firmware, ZPath out, zu64 index){
+    ZBinary fw;
+    if(!ZFile::readBinary(firmware, fw)){
+        ELOG("Failed to read " << firmware);
+        return false;
     }
 
-    // Read firmware
-    ZBinary fwbin;
-    if(!ZFile::readBinary(fwin, fwbin)){
-        LOG("Failed to read file");
-        return -2;
+    // written to a temporary file first, since out may be exe
+    const ZPath tmp = out.str() + ".tmp";
+    const PackageFormat *fmt;
+    {
+        MappedFile file;
+        if(!file.open(exe)){
+            ELOG("Failed to open file");
+            return false;
+        }
+        fmt = exe_format(exe_hash(file), file.data(), file.size());
+        if(!fmt)
+            return false;
+        LOG("Type:        " << fmt->name);
+
+        ZBinary encoded = fw;
+        if(repack_package(*fmt, file.data(), file.size(), index, encoded, tmp)){
+            std::remove(tmp.str().cc());
+            return false;
+        }
     }
 
-    // Encode firmware
-//    Pok3r::encode_firmware(fwbin);
-    ProtoCYKB::encode_firmware(fwbin);
-    encode_package_data(fwbin);
-
-    // Write encoded firmware onto exe
-//    exebin.seek(0x1A3800);
-    exebin.seek(0x2BE000);
-    exebin.write(fwbin);
-
-    ZFile exefile;
-    if(!exefile.open(exeout, ZFile::WRITE)){
-        ELOG("Failed to open file");
-        return -3;
-    }
-    // Write updated exe
-    if(!exefile.write(exebin)){
-        LOG("Write error");
-        return -4;
+    // exe is unmapped, check the new updater and put it in place
+    if(!check_repack(*fmt, tmp, index, fw) || !replaceFile(tmp, out)){
+        std::remove(tmp.str().cc());
+        return false;
     }
-
-    LOG("Out Updater: " << exeout);
-
-    return 0;
+    return true;
 }
@@ -4,19 +4,123 @@
 #include "zbinary.h"
 #include "zpath.h"
 #include "zfile.h"
+#include "zstring.h"
+#include "zarray.h"
 
 using namespace LibChaos;
 
+enum PackType {
+    PACKAGE_NONE = 0,
+    MAAJONSN,   // .maajonsn
+    MAAV102,    // .maaV102
+    MAAV105,    // .maaV105
+    KBPV60,
+    KBPV80,
+};
+
+//! One firmware listed in an updater manifest.
+struct PackageFirmware {
+    //! Firmware description and version, only in maaV105 packages.
+    ZString description;
+    ZString version;
+    //! Layout names for this firmware.
+    ZArray<ZString> layouts;
+    //! Decoded firmware.
+    ZBinary firmware;
+    //! Decoded info section, 180 bytes in maaV102/maaV105 packages, otherwise empty.
+    ZBinary info;
+};
+
+//! Manifest decoded from an updater, with every firmware in package order.
+struct PackageInfo {
+    static const zu64 NO_OUTPUT = ~(zu64)0;
+
+    PackageInfo();
+    static const char *typeName(PackType type);
+    //! Firmware written by a plain decode, null if none.
+    const PackageFirmware *outputFirmware() const;
+
+    zu64 hash;
+    PackType type;
+    ZString description;
+    ZString company;
+    ZString product;
+    ZString version;
+    ZString signature;
+    ZArray<PackageFirmware> firmwares;
+    //! Index of the output firmware in \a firmwares.
+    zu64 output;
+};
+
+//! Identifies an updater from a few KB of the file, without hashing all of it.
+struct PackageFingerprint {
+    zu64 size;
+    //! Hash of the last few KB, covering every strings section.
+    zu64 trailer;
+    //! Hash of evenly spaced blocks from the rest of the file.
+    zu64 sample;
+    //! Full file hash.
+    zu64 hash;
+};
+
+//! Decode the updater encryption of \a size bytes in place.
+void decode_package_data(zbyte *data, zu64 size);
+//! Encode the updater encryption of \a size bytes in place.
+void encode_package_data(zbyte *data, zu64 size);
+//! KBP keystream buffer: one 256 byte period, with the first 16 bytes repeated after it.
+#define KBP_STREAM_LEN  (256 + 16)
+
+//! Fill \a stream with KBP_STREAM_LEN bytes of the KBP keystream for \a key.
+void kbp_keystream(zu32 key, zbyte *stream);
+//! Decrypt (or encrypt) the KBP updater encryption of \a size bytes in place.
+void kbp_decrypt(zbyte *data, zu64 size, zu32 key);
+//! Decrypt the KBP updater encryption and decode the POK3R firmware encryption of \a size bytes in one pass.
+void kbp_decode_pok3r(zbyte *data, zu64 size, zu32 key);
+
+/*! Firmware extracted from a vendor updater executable.
+ *  The executable is memory mapped, and each encoded section is copied once
+ *  into its PackageFirmware and decoded in place.
+ */
 class UpdatePackage {
 public:
     UpdatePackage();
 
     bool loadFromExe(ZPath exe, int index);
 
+    //! Get the output firmware.
     const ZBinary &getFirmware() const;
+    const PackageInfo &getInfo() const { return info; }
+    //! Log the package metadata.
+    void printInfo() const;
+    //! Write each firmware to \a prefix.N.bin and each info section to \a prefix.N.info.
+    bool writeAll(ZPath prefix) const;
+
+    //! Identify the updater \a exe, PACKAGE_NONE if unknown.
+    //! The size and last few KB are looked up in the built-in and cached fingerprints, and a hit
+    //! is confirmed with a sample of the rest of the file. \a hash is set to the full hash of the
+    //! matched updater, or 0 if nothing matched and every known updater has a built-in fingerprint.
+    //! Otherwise the whole file is hashed.
+    static PackType identify(ZPath exe, zu64 &hash);
+    //! Compute the fingerprint of \a exe, hashing the whole file. PACKAGE_NONE if unknown.
+    static PackType fingerprint(ZPath exe, PackageFingerprint &fp);
+
+    //! Decode every .exe updater in \a dir into \a outdir using \a threads workers (0 for one per core),
+    //! then log a report line per file.
+    static bool decodeDirectory(ZPath dir, ZPath outdir, unsigned threads = 0);
+
+    //! Write a copy of the updater \a exe to \a out, with firmware \a index replaced by the
+    //! image in \a firmware. The output firmware is replaced if \a index is NO_OUTPUT.
+    //! The new updater is written to a temporary file and decoded to check the firmware, then
+    //! replaces \a out in one step, so \a out may be \a exe itself.
+    static bool repack(ZPath exe, ZPath firmware, ZPath out, zu64 index = PackageInfo::NO_OUTPUT);
+
+    //! Compare the single pass package and KBP decoders to the references on \a size random bytes.
+    static bool benchmark(zu64 size, zu32 rounds);
 
 private:
-    ZBinary firmware;
+    //! Decoded strings section, reused between loads.
+    ZBinary strings;
+    PackageInfo info;
 };
 
 #endif // UPDATEPACKAGE_H